@@ -0,0 +1,169 @@
+#pragma once
+
+#include "constants.h"
+#include "Color.h"
+#include "Point.h"
+#include "Vec.h"
+#include "Grid.h"
+
+/* The strings and empty regions of a board, found once so the static passes
+ * of an estimate can look them up rather than each flooding the board again.
+ *
+ * Every maximal connected set of points of one value, a string of stones or
+ * a region of empty points, is a component. Components are numbered in the
+ * order a raster scan first comes to them, and for each one the analysis
+ * keeps its points (in the order TGrid::groupAndNeighbors lists them when
+ * started from the component's first point), the distinct points bordering
+ * it, the components those belong to, its liberty count and the colors it
+ * touches. All the lists live back to back in shared flat arrays. */
+class BoardAnalysis {
+    public:
+        class Component {
+            public:
+                int     color;          /* BLACK, WHITE or EMPTY */
+                int     first_point;    /* into points */
+                int     num_points;
+                int     first_neighbor; /* into neighbor_points */
+                int     num_neighbors;
+                int     first_adjacent; /* into adjacent */
+                int     num_adjacent;
+                int     liberties;      /* empty points next to a string, 0 for empty regions */
+                int     borders;        /* bit 0 set if it touches black, bit 1 if white */
+        };
+
+    public:
+        int         width;
+        int         height;
+        int         num_components;
+
+        /* Component of every point */
+        TGrid<int16_t> id;
+
+        Component   components[MAX_VEC_SIZE];
+        Point       points[MAX_VEC_SIZE];
+
+        /* A point borders at most four components, so four times the board
+         * is enough for both of these */
+        Point       neighbor_points[4 * MAX_VEC_SIZE];
+        int         adjacent[4 * MAX_VEC_SIZE];
+
+        BoardAnalysis()
+            : width(0)
+            , height(0)
+            , num_components(0)
+        {
+        }
+
+        /* Labels every component of board */
+        void build(const ColorGrid &board) {
+            width = board.width;
+            height = board.height;
+            id.width = width;
+            id.height = height;
+            id.clear(-1);
+            num_components = 0;
+
+            int         num_points = 0;
+            int         num_neighbor_points = 0;
+            int         num_adjacent = 0;
+            TGrid<int16_t> visited(width, height);
+            Vec         tocheck;
+            Vec         neighbors;
+
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    if (id[y][x] >= 0) {
+                        continue;
+                    }
+
+                    /* Same flood as groupAndNeighbors, so the points come
+                     * out in the same order. Each component stamps visited
+                     * with its own number, which never needs clearing. */
+                    int         c = num_components++;
+                    int         stamp = c + 1;
+                    int         value = board[y][x];
+                    Component  &comp = components[c];
+
+                    comp.color = value;
+                    comp.first_point = num_points;
+                    comp.first_neighbor = num_neighbor_points;
+                    comp.liberties = 0;
+                    comp.borders = 0;
+
+                    ++flood_fill_count;
+                    tocheck.size = 0;
+                    tocheck.push(Point(x, y));
+                    visited[y][x] = stamp;
+
+                    while (tocheck.size) {
+                        Point p = tocheck.remove(0);
+                        int v = board[p];
+                        if (v == value) {
+                            id[p] = c;
+                            points[num_points++] = p;
+                            board.getNeighbors(p, neighbors);
+                            for (int i=0; i < neighbors.size; ++i) {
+                                const Point &neighbor = neighbors[i];
+                                if (visited[neighbor] == stamp) {
+                                    continue;
+                                }
+                                visited[neighbor] = stamp;
+                                tocheck.push(neighbor);
+                            }
+                        } else {
+                            neighbor_points[num_neighbor_points++] = p;
+                            comp.liberties += v == EMPTY;
+                            comp.borders |= (v == BLACK) | ((v == WHITE) << 1);
+                        }
+                    }
+
+                    comp.num_points = num_points - comp.first_point;
+                    comp.num_neighbors = num_neighbor_points - comp.first_neighbor;
+                }
+            }
+
+            /* With every point labelled the neighboring components can be
+             * linked up, listing each one once */
+            int listed[MAX_VEC_SIZE];
+            for (int c=0; c < num_components; ++c) {
+                listed[c] = 0;
+            }
+            for (int c=0; c < num_components; ++c) {
+                Component &comp = components[c];
+                comp.first_adjacent = num_adjacent;
+                for (int i=0; i < comp.num_neighbors; ++i) {
+                    int a = id[neighbor_points[comp.first_neighbor + i]];
+                    if (listed[a] != c + 1) {
+                        listed[a] = c + 1;
+                        adjacent[num_adjacent++] = a;
+                    }
+                }
+                comp.num_adjacent = num_adjacent - comp.first_adjacent;
+            }
+        }
+
+        inline const Component& operator[](int c) const { return components[c]; }
+        inline const Component& at(const Point &p) const { return components[id[p]]; }
+
+        inline const Point* points_of(int c) const { return points + components[c].first_point; }
+        inline const Point* neighbors_of(int c) const { return neighbor_points + components[c].first_neighbor; }
+        inline const int* adjacent_to(int c) const { return adjacent + components[c].first_adjacent; }
+
+        /* Writes the points of component c to group */
+        void group(int c, Vec &group) const {
+            const Point *p = points_of(c);
+            group.size = 0;
+            for (int i=0; i < components[c].num_points; ++i) {
+                group.push(p[i]);
+            }
+        }
+
+        /* Writes the points bordering component c to neighbors */
+        void neighbors(int c, Vec &neighbors) const {
+            const Point *p = neighbors_of(c);
+            neighbors.size = 0;
+            for (int i=0; i < components[c].num_neighbors; ++i) {
+                neighbors.push(p[i]);
+            }
+        }
+};
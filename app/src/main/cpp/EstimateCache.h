@@ -0,0 +1,243 @@
+#pragma once
+
+#include "constants.h"
+#include "Color.h"
+#include "Grid.h"
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <unordered_map>
+#ifdef USE_THREADS
+#  include <mutex>
+#endif
+
+/* Cache of finished estimates, keyed by position and estimate parameters.
+ *
+ * Positions are canonicalised over the 8 symmetries of the board (the four
+ * rotations, each optionally mirrored) before hashing, so a rotated or
+ * mirrored copy of a position that was already estimated is a hit too. The
+ * hash is a Zobrist hash of the canonical board mixed with the board size,
+ * the side to move, the trial count, tolerance and rollout seed. Entries also keep the
+ * canonical board itself, so a hash collision can never return someone
+ * else's estimate.
+ *
+ * At most ESTIMATE_CACHE_SIZE entries are kept, the least recently used one
+ * is evicted to make room. */
+class EstimateCache {
+    public:
+        class Key {
+            public:
+                uint64_t    hash;
+                int         symmetry;
+                int         width;      /* of the original board */
+                int         height;
+                int         canonical_width;
+                int         canonical_height;
+                int         player_to_move;
+                int         trials;
+                float       tolerance;
+                bool        adaptive;
+                unsigned    seed;
+                int8_t      board[MAX_VEC_SIZE];
+
+                bool operator==(const Key &o) const {
+                    return hash == o.hash
+                        && canonical_width == o.canonical_width
+                        && canonical_height == o.canonical_height
+                        && player_to_move == o.player_to_move
+                        && trials == o.trials
+                        && tolerance == o.tolerance
+                        && adaptive == o.adaptive
+                        && seed == o.seed
+                        && memcmp(board, o.board, canonical_width * canonical_height) == 0;
+                }
+        };
+
+        /* Builds the cache key for estimating board */
+        static void make_key(Key &key, const ColorGrid &board, Color player_to_move, int trials, float tolerance, bool adaptive, unsigned seed) {
+            const uint64_t (&zobrist)[2][MAX_VEC_SIZE] = zobrist_table();
+            int w = board.width;
+            int h = board.height;
+            uint64_t hashes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+            for (int y=0; y < h; ++y) {
+                for (int x=0; x < w; ++x) {
+                    int c = board[y][x];
+                    if (c == EMPTY) {
+                        continue;
+                    }
+                    for (int s=0; s < 8; ++s) {
+                        int tx, ty;
+                        transform(s, w, h, x, y, tx, ty);
+                        hashes[s] ^= zobrist[c == BLACK ? 0 : 1][ty * MAX_WIDTH + tx];
+                    }
+                }
+            }
+
+            int best = 0;
+            for (int s=0; s < 8; ++s) {
+                int tw = (s & 4) ? h : w;
+                int th = (s & 4) ? w : h;
+                hashes[s] = mix(hashes[s] ^ mix(((uint64_t)tw << 8) | (uint64_t)th));
+                if (hashes[s] < hashes[best]) {
+                    best = s;
+                }
+            }
+
+            uint32_t tolerance_bits;
+            memcpy(&tolerance_bits, &tolerance, sizeof(tolerance_bits));
+
+            key.symmetry         = best;
+            key.width            = w;
+            key.height           = h;
+            key.canonical_width  = (best & 4) ? h : w;
+            key.canonical_height = (best & 4) ? w : h;
+            key.player_to_move   = player_to_move;
+            key.trials           = trials;
+            key.tolerance        = tolerance;
+            key.adaptive         = adaptive;
+            key.seed             = seed;
+            key.hash             = mix(hashes[best]
+                                       ^ mix(((uint64_t)(uint32_t)trials << 32) | tolerance_bits)
+                                       ^ mix((uint64_t)seed << 8)
+                                       ^ ((uint64_t)(player_to_move + 2) << 1)
+                                       ^ (uint64_t)adaptive);
+
+            for (int y=0; y < h; ++y) {
+                for (int x=0; x < w; ++x) {
+                    int tx, ty;
+                    transform(best, w, h, x, y, tx, ty);
+                    key.board[ty * key.canonical_width + tx] = (int8_t)board[y][x];
+                }
+            }
+        }
+
+        /* Looks up an estimate, filling out (sized like the original board)
+         * and returning true on a hit. */
+        bool lookup(const Key &key, Grid &out) {
+#ifdef USE_THREADS
+            std::lock_guard<std::mutex> lock(mutex);
+#endif
+            Index::iterator it = index.find(key.hash);
+            if (it == index.end() || !(it->second->key == key)) {
+                return false;
+            }
+
+            /* move to the front of the LRU list */
+            entries.splice(entries.begin(), entries, it->second);
+
+            const Entry &e = *it->second;
+            for (int y=0; y < key.height; ++y) {
+                for (int x=0; x < key.width; ++x) {
+                    int tx, ty;
+                    transform(key.symmetry, key.width, key.height, x, y, tx, ty);
+                    out[y][x] = e.result[ty * key.canonical_width + tx];
+                }
+            }
+            return true;
+        }
+
+        void store(const Key &key, const Grid &result) {
+#ifdef USE_THREADS
+            std::lock_guard<std::mutex> lock(mutex);
+#endif
+            Index::iterator it = index.find(key.hash);
+            if (it != index.end()) {
+                /* either the same position stored by another thread, or a
+                 * hash collision. Either way the newer one wins. */
+                entries.erase(it->second);
+                index.erase(it);
+            }
+
+            while ((int)entries.size() >= ESTIMATE_CACHE_SIZE) {
+                index.erase(entries.back().key.hash);
+                entries.pop_back();
+            }
+
+            entries.push_front(Entry());
+            Entry &e = entries.front();
+            e.key = key;
+            for (int y=0; y < key.height; ++y) {
+                for (int x=0; x < key.width; ++x) {
+                    int tx, ty;
+                    transform(key.symmetry, key.width, key.height, x, y, tx, ty);
+                    e.result[ty * key.canonical_width + tx] = (int8_t)result[y][x];
+                }
+            }
+            index[key.hash] = entries.begin();
+        }
+
+        void clear() {
+#ifdef USE_THREADS
+            std::lock_guard<std::mutex> lock(mutex);
+#endif
+            entries.clear();
+            index.clear();
+        }
+
+        int size() {
+#ifdef USE_THREADS
+            std::lock_guard<std::mutex> lock(mutex);
+#endif
+            return (int)entries.size();
+        }
+
+        /* The process wide cache used by Goban::estimate */
+        static EstimateCache& instance() {
+            static EstimateCache cache;
+            return cache;
+        }
+
+        /* Maps (x,y) on a w x h board through symmetry s: bit 2 transposes,
+         * then bits 0 and 1 mirror horizontally and vertically. */
+        static inline void transform(int s, int w, int h, int x, int y, int &tx, int &ty) {
+            if (s & 4) {
+                int t = x; x = y; y = t;
+                t = w; w = h; h = t;
+            }
+            tx = (s & 1) ? w - 1 - x : x;
+            ty = (s & 2) ? h - 1 - y : y;
+        }
+
+    private:
+        class Entry {
+            public:
+                Key     key;
+                int8_t  result[MAX_VEC_SIZE];
+        };
+
+        typedef std::list<Entry> List;
+        typedef std::unordered_map<uint64_t, List::iterator> Index;
+
+        List    entries;
+        Index   index;
+#ifdef USE_THREADS
+        std::mutex mutex;
+#endif
+
+        /* splitmix64 finalizer */
+        static inline uint64_t mix(uint64_t z) {
+            z += 0x9e3779b97f4a7c15ULL;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        static const uint64_t (&zobrist_table())[2][MAX_VEC_SIZE] {
+            static uint64_t table[2][MAX_VEC_SIZE];
+            static bool initialized = init_zobrist(table);
+            (void)initialized;
+            return table;
+        }
+
+        static bool init_zobrist(uint64_t (&table)[2][MAX_VEC_SIZE]) {
+            uint64_t state = 0x5eed;
+            for (int c=0; c < 2; ++c) {
+                for (int i=0; i < MAX_VEC_SIZE; ++i) {
+                    state = mix(state);
+                    table[c][i] = state;
+                }
+            }
+            return true;
+        }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "constants.h"
+#include "Grid.h"
+
+/* What an estimate leaves behind for warm starting the estimate of the next
+ * position, see Goban::estimate_incremental.
+ *
+ * It keeps the position as it was given and as it was after its false eyes
+ * got filled, and for each rollout pass (0 for the seki pass, 1 for pass1)
+ * the ownership counts, scaled to num_iterations trials as rollout() scales
+ * them, together with the number of trials each point's count is made of.
+ * Only an estimate with the same trial count, tolerance and seed can use
+ * it. A cancelled estimate leaves it invalid. */
+class EstimatePrior {
+    public:
+        bool        valid;
+        int         num_iterations;
+        float       tolerance;
+        unsigned    seed;
+
+        ColorGrid   board;
+        ColorGrid   filled;
+        Grid        counts[2];
+        Grid        weight[2];
+
+        EstimatePrior(int width, int height)
+            : valid(false)
+            , num_iterations(0)
+            , tolerance(0)
+            , seed(0)
+            , board(width, height)
+            , filled(width, height)
+        {
+            for (int pass=0; pass < 2; ++pass) {
+                counts[pass] = Grid(width, height);
+                weight[pass] = Grid(width, height);
+            }
+        }
+
+        /* True if an estimate of given with these parameters can start from
+         * this one */
+        bool matches(const ColorGrid &given, int num_iterations, float tolerance, unsigned seed) const {
+            return valid
+                && board.width == given.width
+                && board.height == given.height
+                && this->num_iterations == num_iterations
+                && this->tolerance == tolerance
+                && this->seed == seed;
+        }
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "constants.h"
+#include <chrono>
+
+/* Counters for one phase of an estimate */
+class PhaseStats {
+    public:
+        long long   nanoseconds;
+        long long   playouts;
+        long long   moves;          /* stones placed during playouts */
+        long long   captures;       /* stones captured during playouts */
+        long long   illegal_moves;  /* playout moves rejected as eyes, suicide or ko */
+        long long   flood_fills;
+
+        enum {
+            NUM_COUNTERS = 6,
+        };
+
+        PhaseStats()
+            : nanoseconds(0)
+            , playouts(0)
+            , moves(0)
+            , captures(0)
+            , illegal_moves(0)
+            , flood_fills(0)
+        {
+        }
+
+        PhaseStats& operator+=(const PhaseStats &o) {
+            nanoseconds   += o.nanoseconds;
+            playouts      += o.playouts;
+            moves         += o.moves;
+            captures      += o.captures;
+            illegal_moves += o.illegal_moves;
+            flood_fills   += o.flood_fills;
+            return *this;
+        }
+
+        /* Writes the counters to out in declaration order */
+        void store(long long *out) const {
+            out[0] = nanoseconds;
+            out[1] = playouts;
+            out[2] = moves;
+            out[3] = captures;
+            out[4] = illegal_moves;
+            out[5] = flood_fills;
+        }
+};
+
+/* Where the time of one Goban::estimate call went, phase by phase */
+class EstimateStats {
+    public:
+        enum Phase {
+            FALSE_EYES = 0,
+            COMPONENTS,     /* labelling the strings and empty regions, see BoardAnalysis */
+            SEKI_ROLLOUT,
+            SEKI_SCAN,
+            HORSESHOE,
+            STATIC_MAPS,    /* territory, group, liberty and strong life maps */
+            PASS1,
+            DEAD,
+            HOLE_FILL,      /* thresholding pass1 and filling in single colored holes */
+
+            NUM_PHASES
+        };
+
+        PhaseStats  phases[NUM_PHASES];
+
+        PhaseStats total() const {
+            PhaseStats ret;
+            for (int i=0; i < NUM_PHASES; ++i) {
+                ret += phases[i];
+            }
+            return ret;
+        }
+
+        /* Writes NUM_PHASES * PhaseStats::NUM_COUNTERS counters to out, phase by phase */
+        void store(long long *out) const {
+            for (int i=0; i < NUM_PHASES; ++i) {
+                phases[i].store(out + i * PhaseStats::NUM_COUNTERS);
+            }
+        }
+
+        static const char* phase_name(int phase) {
+            static const char *names[NUM_PHASES] = {
+                "false_eyes", "components", "seki_rollout", "seki_scan",
+                "horseshoe", "static_maps", "pass1", "dead", "hole_fill",
+            };
+            return phase >= 0 && phase < NUM_PHASES ? names[phase] : "unknown";
+        }
+};
+
+/* Charges the wall time and the flood fills of the calling thread between
+ * construction and destruction to one phase of stats, if stats is set */
+class PhaseTimer {
+    public:
+        PhaseTimer(EstimateStats *stats, int phase)
+            : stats(stats)
+            , phase(phase)
+            , floods(flood_fill_count)
+            , start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~PhaseTimer() {
+            if (stats) {
+                PhaseStats &p = stats->phases[phase];
+                p.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                p.flood_fills += flood_fill_count - floods;
+            }
+        }
+
+    private:
+        EstimateStats  *stats;
+        int             phase;
+        long long       floods;
+        std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "constants.h"
+#include "Grid.h"
+#include "BoardAnalysis.h"
+#include "PlayoutBoard.h"
+#include "EstimateStats.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/* Scratch memory for estimates, one per thread and kept from one estimate
+ * to the next.
+ *
+ * It holds the large working buffers of an estimate: the component index,
+ * and the per worker ownership grids and playout boards of the rollouts. An
+ * estimate then neither allocates them again for every batch of rollouts nor
+ * puts them on the stack. Buffers are handed out as they were left. Whoever
+ * takes one clears or overwrites only the part its board size uses, so
+ * nothing is cleared up front.
+ *
+ * Playout boards are only kept for the board size last estimated. release()
+ * hands the whole workspace back, for threads that aren't going to estimate
+ * again any time soon, and trim() does so only while more than
+ * ESTIMATE_WORKSPACES threads hold one, for callers that can't tell. */
+class EstimateWorkspace {
+    public:
+        /* Component index of the estimate running on this thread, and
+         * the one built for passes called outside of an estimate, see
+         * Goban::board_analysis */
+        BoardAnalysis   analysis;
+        BoardAnalysis   scratch_analysis;
+
+        /* count ownership grids of width x height, zeroed */
+        std::vector<Grid>& partials(int count, int width, int height) {
+            if ((int)grids.size() < count) {
+                grids.resize(count, Grid(width, height));
+            }
+            for (int i=0; i < count; ++i) {
+                grids[i].width = width;
+                grids[i].height = height;
+                grids[i].clear();
+            }
+            return grids;
+        }
+
+        /* count zeroed sets of playout counters */
+        std::vector<PhaseStats>& counters(int count) {
+            if ((int)stats.size() < count) {
+                stats.resize(count);
+            }
+            for (int i=0; i < count; ++i) {
+                stats[i] = PhaseStats();
+            }
+            return stats;
+        }
+
+        /* count playout boards of width x height (SIZE x SIZE unless SIZE is
+         * 0), as the last user left them. Callers reset them before use. */
+        template<int SIZE>
+        std::vector<TPlayoutBoard<SIZE> >& playouts(int count, int width, int height) {
+            if (pool_width != width || pool_height != height) {
+                free_pool(boards_any);
+                free_pool(boards_9);
+                free_pool(boards_13);
+                free_pool(boards_19);
+                pool_width = width;
+                pool_height = height;
+            }
+            std::vector<TPlayoutBoard<SIZE> > &boards = playout_pool<SIZE>();
+            if ((int)boards.size() < count) {
+                boards.resize(count, TPlayoutBoard<SIZE>(width, height));
+            }
+            return boards;
+        }
+
+        /* The calling thread's workspace, created on first use */
+        static EstimateWorkspace& local() {
+            std::unique_ptr<EstimateWorkspace> &workspace = slot();
+            if (!workspace) {
+                workspace.reset(new EstimateWorkspace());
+            }
+            return *workspace;
+        }
+
+        /* Frees the calling thread's workspace, the next local() starts a
+         * new one. Must not be called while an estimate is running on the
+         * thread. */
+        static void release() {
+            slot().reset();
+        }
+
+        /* Frees the calling thread's workspace if more than
+         * ESTIMATE_WORKSPACES threads hold one, so that callers estimating
+         * from any number of threads keep at most that many around. Same
+         * restriction as release(). */
+        static void trim() {
+            if (slot() && live() > ESTIMATE_WORKSPACES) {
+                slot().reset();
+            }
+        }
+
+        ~EstimateWorkspace() {
+            --live();
+        }
+
+    private:
+        std::vector<Grid>       grids;
+        std::vector<PhaseStats> stats;
+
+        /* Playout boards of the size in pool_width x pool_height, in the
+         * pool matching its TPlayoutBoard specialisation */
+        int                                 pool_width;
+        int                                 pool_height;
+        std::vector<TPlayoutBoard<0> >      boards_any;
+        std::vector<TPlayoutBoard<9> >      boards_9;
+        std::vector<TPlayoutBoard<13> >     boards_13;
+        std::vector<TPlayoutBoard<19> >     boards_19;
+
+        EstimateWorkspace()
+            : pool_width(0)
+            , pool_height(0)
+        {
+            ++live();
+        }
+
+        /* Number of workspaces in existence across all threads */
+        static std::atomic<int>& live() {
+            static std::atomic<int> count(0);
+            return count;
+        }
+
+        static std::unique_ptr<EstimateWorkspace>& slot() {
+            static THREAD_LOCAL std::unique_ptr<EstimateWorkspace> workspace;
+            return workspace;
+        }
+
+        template<int SIZE>
+        std::vector<TPlayoutBoard<SIZE> >& playout_pool();
+
+        template<class T>
+        static void free_pool(std::vector<T> &pool) {
+            std::vector<T>().swap(pool);
+        }
+};
+
+template<> inline std::vector<TPlayoutBoard<0> >& EstimateWorkspace::playout_pool<0>() { return boards_any; }
+template<> inline std::vector<TPlayoutBoard<9> >& EstimateWorkspace::playout_pool<9>() { return boards_9; }
+template<> inline std::vector<TPlayoutBoard<13> >& EstimateWorkspace::playout_pool<13>() { return boards_13; }
+template<> inline std::vector<TPlayoutBoard<19> >& EstimateWorkspace::playout_pool<19>() { return boards_19; }
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "constants.h"
+#include "Color.h"
+#include "Point.h"
+#include "Vec.h"
+#include "Grid.h"
+#include "Goban.h"
+#include "EstimateStats.h"
+#include <string.h>
+#include <vector>
+
+/* A game kept on the native side, so callers can send the moves as they are
+ * played instead of the whole board for every estimate.
+ *
+ * play() places a stone with Goban::place_and_remove, which takes off any
+ * captured strings, and enforces ko itself, pass() records a pass and undo()
+ * takes back the last move or pass, putting captured stones back. load()
+ * replaces the position outright and forgets the history, for setups, jumps
+ * and anything else that isn't a single step.
+ *
+ * The last estimate is kept along with the board and parameters it was made
+ * for and handed out again as long as those still match, which is the case
+ * after a pass, or after an undo followed by the same move again. Any other
+ * position is estimated warm started from the last one, see
+ * Goban::estimate_incremental, so a game stepped through move by move only
+ * redoes the part of the board each move touches. The session is not thread
+ * safe, callers serialise access to it. */
+class GameSession {
+    public:
+        GameSession(int width, int height)
+            : goban(width, height)
+            , ko(-1, -1)
+            , has_estimate(false)
+            , estimate_board(width, height)
+            , last_estimate(width, height)
+            , prior(width, height)
+        {
+            goban.adaptive = true;
+            goban.do_ko_check = 0;
+            goban.possible_ko = Point(-1, -1);
+        }
+
+        inline int width() const { return goban.width; }
+        inline int height() const { return goban.height; }
+        inline const ColorGrid& board() const { return goban.board; }
+        inline int moves() const { return (int)history.size(); }
+
+        /* Replaces the position with board and clears the history, ko
+         * included */
+        void load(const ColorGrid &board) {
+            goban.board = board;
+            ko = Point(-1, -1);
+            history.clear();
+            captures.clear();
+        }
+
+        /* Plays player's stone at move. Returns the number of stones
+         * captured, or -1 if player isn't BLACK or WHITE or the move is off
+         * the board, on a stone, suicide or retakes a ko, in which case
+         * nothing changes. */
+        int play(Point move, Color player) {
+            if ((player != BLACK && player != WHITE)
+                || move.x < 0 || move.y < 0 || move.x >= goban.width || move.y >= goban.height
+                || goban.board[move] != EMPTY) {
+                return -1;
+            }
+
+            Vec removed;
+            /* Goban's own ko check is left off, it takes any single stone
+             * capture for a ko, snapbacks included */
+            goban.do_ko_check = 0;
+            Goban::Result result = goban.place_and_remove(move, player, removed);
+            if (result != Goban::OK) {
+                return -1;
+            }
+            if (move == ko && removed.size == 1) {
+                goban.board[move] = EMPTY;
+                goban.board[removed[0]] = -player;
+                return -1;
+            }
+
+            Move m;
+            m.move = move;
+            m.player = player;
+            m.ko = ko;
+            m.first_capture = (int)captures.size();
+            m.num_captures = removed.size;
+            for (int i=0; i < removed.size; ++i) {
+                captures.push_back(removed[i]);
+            }
+            history.push_back(m);
+
+            ko = removed.size == 1 && in_ko_shape(move, player) ? removed[0] : Point(-1, -1);
+            return removed.size;
+        }
+
+        /* A pass changes nothing on the board but lifts the ko. False, and
+         * nothing recorded, if player isn't BLACK or WHITE. */
+        bool pass(Color player) {
+            if (player != BLACK && player != WHITE) {
+                return false;
+            }
+
+            Move m;
+            m.move = Point(-1, -1);
+            m.player = player;
+            m.ko = ko;
+            m.first_capture = (int)captures.size();
+            m.num_captures = 0;
+            history.push_back(m);
+            ko = Point(-1, -1);
+            return true;
+        }
+
+        /* Takes back the last move or pass, false if there is none */
+        bool undo() {
+            if (history.empty()) {
+                return false;
+            }
+
+            const Move &m = history.back();
+            if (m.move.x >= 0) {
+                goban.board[m.move] = EMPTY;
+                for (int i=0; i < m.num_captures; ++i) {
+                    goban.board[captures[m.first_capture + i]] = -m.player;
+                }
+            }
+            ko = m.ko;
+            captures.resize(m.first_capture);
+            history.pop_back();
+            return true;
+        }
+
+        /* Estimates the current position, within budget_ms milliseconds if
+         * that is positive, starting from the previous estimate. Asking again
+         * for the same position with the same parameters returns the
+         * previous estimate without playing any trials, trials_used is then
+         * 0 and stats are left as they were for it. */
+        Grid estimate(Color player_to_move, int trials, float tolerance, unsigned seed, int budget_ms, int *trials_used = NULL, EstimateStats *stats = NULL) {
+            if (has_estimate
+                && estimate_player == player_to_move
+                && estimate_trials == trials
+                && estimate_tolerance == tolerance
+                && estimate_seed == seed
+                && estimate_budget_ms == budget_ms
+                && same_board(estimate_board, goban.board)) {
+                if (trials_used) {
+                    *trials_used = 0;
+                }
+                if (stats) {
+                    *stats = last_stats;
+                }
+                return last_estimate;
+            }
+
+            /* The session may be used from another thread than the one that
+             * made it, and Grid's defaults are per thread */
+            default_grid_width = goban.width;
+            default_grid_height = goban.height;
+
+            goban.seed = seed;
+            int used = 0;
+            EstimateStats estimate_stats;
+            last_estimate = goban.estimate_incremental(player_to_move, trials, tolerance, prior, budget_ms, &used, &estimate_stats);
+
+            has_estimate = true;
+            estimate_board = goban.board;
+            estimate_player = player_to_move;
+            estimate_trials = trials;
+            estimate_tolerance = tolerance;
+            estimate_seed = seed;
+            estimate_budget_ms = budget_ms;
+            last_stats = estimate_stats;
+
+            if (trials_used) {
+                *trials_used = used;
+            }
+            if (stats) {
+                *stats = estimate_stats;
+            }
+            return last_estimate;
+        }
+
+    private:
+        /* A move or pass (move at -1, -1) as played, with the ko point
+         * before it and its captures, which live in captures */
+        class Move {
+            public:
+                Point   move;
+                int     player;
+                Point   ko;
+                int     first_capture;
+                int     num_captures;
+        };
+
+        Goban               goban;
+        std::vector<Move>   history;
+        std::vector<Point>  captures;
+
+        /* The point the player to move can't retake a ko at, -1, -1 if
+         * there is none */
+        Point               ko;
+
+        /* The last estimate and what it was made for */
+        bool                has_estimate;
+        ColorGrid           estimate_board;
+        Color               estimate_player;
+        int                 estimate_trials;
+        float               estimate_tolerance;
+        unsigned            estimate_seed;
+        int                 estimate_budget_ms;
+        Grid                last_estimate;
+        EstimateStats       last_stats;
+
+        /* What the last estimate left for warm starting the next one */
+        EstimatePrior       prior;
+
+        /* True if the stone player just played at move is on its own with
+         * a single liberty, the point it captured on. Retaking that point
+         * captures it straight back, a ko, unless more than that one stone
+         * would be captured. */
+        bool in_ko_shape(Point move, Color player) const {
+            Vec neighbors;
+            goban.board.getNeighbors(move, neighbors);
+            int liberties = 0;
+            for (int i=0; i < neighbors.size; ++i) {
+                int c = goban.board[neighbors[i]];
+                if (c == player) {
+                    return false;
+                }
+                liberties += c == EMPTY;
+            }
+            return liberties == 1;
+        }
+
+        static bool same_board(const ColorGrid &a, const ColorGrid &b) {
+            if (a.width != b.width || a.height != b.height) {
+                return false;
+            }
+            for (int y=0; y < a.height; ++y) {
+                if (memcmp(a[y], b[y], a.width * sizeof(a[y][0])) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+};
@@ -2,8 +2,14 @@
 #include "Goban.h"
 #include "log.h"
 #include <set>
+#include <vector>
+#ifdef USE_THREADS
+#  include <thread>
+#  include <atomic>
+#endif
 
 #  include <stdlib.h>
+#  include <math.h>
 
 #ifndef EMSCRIPTEN
 #  include <string.h>
@@ -21,15 +27,35 @@
 
 using namespace std; 
 
+THREAD_LOCAL int default_grid_width = -1000000;
+THREAD_LOCAL int default_grid_height = -1000000;
+THREAD_LOCAL long long flood_fill_count = 0;
+THREAD_LOCAL FloodMarks flood_marks;
+
+/* Derives an independent rollout seed from seed and stream */
+static inline unsigned mix_seed(unsigned seed, unsigned stream) {
+    return (unsigned)PlayoutRandom::mix(((uint64_t)seed << 32) + stream + 0x9e3779b97f4a7c15ULL);
+}
+
 Goban::Goban(int width, int height) 
     : width(width)
     , height(height) 
     , board(width, height) 
     , global_visited(width, height) 
     , last_visited_counter(1)
-#ifdef USE_THREADS
-    , rand(::rand())
-#endif
+    , num_threads(0)
+    , seed(ROLLOUT_DEFAULT_SEED)
+    , adaptive(false)
+    , use_cache(true)
+    , rand(ROLLOUT_DEFAULT_SEED)
+    , stats(NULL)
+    , analysis(NULL)
+    , prior(NULL)
+    , warm(false)
+    , focus(width, height)
+    , current_pass(0)
+    , time_budget_ms(0)
+    , has_deadline(false)
 {
     default_grid_width = width;
     default_grid_height = height;
@@ -44,10 +70,20 @@ Goban::Goban(const Goban &other) {
 
     this->global_visited = other.global_visited;
     this->last_visited_counter = other.last_visited_counter;
-
-#ifdef USE_THREADS
-    rand = std::mt19937(::rand());
-#endif
+    this->num_threads = other.num_threads;
+    this->seed = other.seed;
+    this->adaptive = other.adaptive;
+    this->use_cache = other.use_cache;
+    this->stats = other.stats;
+    this->analysis = NULL;
+    this->prior = NULL;
+    this->warm = false;
+    this->current_pass = other.current_pass;
+    this->time_budget_ms = other.time_budget_ms;
+    this->has_deadline = other.has_deadline;
+    this->deadline = other.deadline;
+
+    this->rand = other.rand;
 }
 
 void Goban::setBoardSize(int width, int height) {
@@ -64,15 +100,142 @@ void Goban::setBoardSize(int width, int height) {
     default_grid_width = width;
     default_grid_height = height;
 }
-Grid Goban::estimate(Color player_to_move, int num_iterations, float tolerance, bool debug) const {
+Grid Goban::estimate(Color player_to_move, int num_iterations, float tolerance, bool debug, int *trials_used, EstimateStats *stats) const {
+    /* Debug runs are all about the printouts, so they always do the work */
+    bool cached = use_cache && !debug;
+    EstimateCache::Key key;
+
+    if (stats) {
+        *stats = EstimateStats();
+    }
+
+    if (cached) {
+        EstimateCache::make_key(key, board, player_to_move, num_iterations, tolerance, adaptive, seed);
+        Grid ret(width, height);
+        if (EstimateCache::instance().lookup(key, ret)) {
+            if (trials_used) {
+                *trials_used = 0;
+            }
+            return ret;
+        }
+    }
+
+    Goban t(*this);
+    t.stats = stats;
+    int pass_trials[2] = { 0, 0 };
+    Grid ret = t._estimate(player_to_move, num_iterations, tolerance, debug, pass_trials);
+    if (trials_used) {
+        *trials_used = pass_trials[0] + pass_trials[1];
+    }
+
+    if (cached) {
+        EstimateCache::instance().store(key, ret);
+    }
+    return ret;
+}
+Grid Goban::estimate_for(Color player_to_move, double budget_ms, float tolerance, int max_trials, int *seki_trials, int *pass1_trials, EstimateStats *stats) const {
+    Goban t(*this);
+    t.time_budget_ms = budget_ms;
+    t.stats = stats;
+    if (stats) {
+        *stats = EstimateStats();
+    }
+
+    int pass_trials[2] = { 0, 0 };
+    Grid ret = t._estimate(player_to_move, max_trials, tolerance, false, pass_trials);
+    if (seki_trials) {
+        *seki_trials = pass_trials[0];
+    }
+    if (pass1_trials) {
+        *pass1_trials = pass_trials[1];
+    }
+    return ret;
+}
+
+Grid Goban::estimate_incremental(Color player_to_move, int num_iterations, float tolerance, EstimatePrior &prior, double budget_ms, int *trials_used, EstimateStats *stats) const {
     Goban t(*this);
-    return t._estimate(player_to_move, num_iterations, tolerance, debug);
+    t.time_budget_ms = budget_ms;
+    t.stats = stats;
+    t.prior = &prior;
+    if (stats) {
+        *stats = EstimateStats();
+    }
+
+    int pass_trials[2] = { 0, 0 };
+    Grid ret = t._estimate(player_to_move, num_iterations, tolerance, false, pass_trials);
+    if (trials_used) {
+        *trials_used = pass_trials[0] + pass_trials[1];
+    }
+    return ret;
 }
 
-Grid Goban::_estimate(Color player_to_move, int num_iterations, float tolerance, bool debug) {
+#ifdef USE_THREADS
+static void estimate_batch_worker(Goban *g, std::atomic<int> *next, int count, const int *boards, const int *players_to_move, int trials, float tolerance, unsigned seed, bool column_major, int *out) {
+#else
+static void estimate_batch_worker(Goban *g, int *next, int count, const int *boards, const int *players_to_move, int trials, float tolerance, unsigned seed, bool column_major, int *out) {
+#endif
+    int size = g->width * g->height;
+    int x_step = column_major ? g->height : 1;
+    int y_step = column_major ? 1 : g->width;
+
+    /* Positions are handed out one at a time, whoever is free takes the next */
+    for (int i = (*next)++; i < count; i = (*next)++) {
+        const int *in = boards + i * size;
+        for (int y=0; y < g->height; ++y) {
+            for (int x=0; x < g->width; ++x) {
+                g->board[y][x] = in[x * x_step + y * y_step];
+            }
+        }
+
+        g->seed = mix_seed(seed, i);
+        Grid est = g->estimate((Color)players_to_move[i], trials, tolerance, false);
+
+        int *o = out + i * size;
+        for (int y=0; y < g->height; ++y) {
+            for (int x=0; x < g->width; ++x) {
+                o[x * x_step + y * y_step] = est[y][x];
+            }
+        }
+    }
+}
+void Goban::estimate_batch(int width, int height, int count, const int *boards, const int *players_to_move, int trials, float tolerance, unsigned seed, int num_threads, bool adaptive, bool column_major, int *out) {
+    int num_workers = 1;
+#ifdef USE_THREADS
+    num_workers = num_threads > 0 ? num_threads : (int)thread::hardware_concurrency();
+    num_workers = MAX(1, MIN(num_workers, count));
+#endif
+
+    /* One board per worker, set up here since the Goban constructor isn't
+     * safe to run from several threads at once. */
+    vector<Goban> workers(num_workers, Goban(width, height));
+    for (int w=0; w < num_workers; ++w) {
+        workers[w].num_threads = 1;
+        workers[w].adaptive = adaptive;
+    }
+
+#ifdef USE_THREADS
+    std::atomic<int> next(0);
+    vector<thread> threads;
+    for (int w=1; w < num_workers; ++w) {
+        threads.push_back(thread(estimate_batch_worker, &workers[w], &next, count, boards, players_to_move, trials, tolerance, seed, column_major, out));
+    }
+    estimate_batch_worker(&workers[0], &next, count, boards, players_to_move, trials, tolerance, seed, column_major, out);
+    for (size_t i=0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+#else
+    int next = 0;
+    estimate_batch_worker(&workers[0], &next, count, boards, players_to_move, trials, tolerance, seed, column_major, out);
+#endif
+}
+
+Grid Goban::_estimate(Color player_to_move, int num_iterations, float tolerance, bool debug, int *pass_trials) {
     default_grid_width = width;
     default_grid_height = height;
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> budget(time_budget_ms);
+
 
 #ifndef EMSCRIPTEN
     if (debug) {
@@ -81,44 +244,100 @@ Grid Goban::_estimate(Color player_to_move, int num_iterations, float tolerance,
             NOTE << "False eyes: " << false_eyes << endl;
         }
     }
+#else
+    (void)debug;
 #endif
 
-    fillFalseEyes();
+    /* The prior is compared with the position as given as well as with
+     * the filled in one */
+    ColorGrid given(width, height);
+    unsigned given_seed = seed;
+    if (prior) {
+        given = board;
+    }
+
+    {
+        PhaseTimer timer(stats, EstimateStats::FALSE_EYES);
+        fillFalseEyes();
+    }
+
+    /* The board stays as it is from here on, so its strings and regions
+     * only need finding once */
+    BoardAnalysis &components = EstimateWorkspace::local().analysis;
+    {
+        PhaseTimer timer(stats, EstimateStats::COMPONENTS);
+        components.build(board);
+    }
+    analysis = &components;
+
+    warm = false;
+    if (prior) {
+        PhaseTimer timer(stats, EstimateStats::COMPONENTS);
+        if (prior->matches(given, num_iterations, tolerance, given_seed)) {
+            /* A change that reaches most of the board leaves too little to
+             * go on, that gets estimated from scratch */
+            warm = warm_start(given) * 2 <= width * height;
+        }
+        /* From here on it gets overwritten bit by bit, it is only good again
+         * once this estimate is through */
+        prior->valid = false;
+    }
 
     /* Look for seki, or similar situations */
     int seki_pass_iterations = num_iterations;
-    Grid seki_pass = rollout(seki_pass_iterations, player_to_move, false);
-    //Grid seki = scanForSeki(num_iterations, tolerance, seki_pass);
-    Grid seki = scanForSeki(num_iterations, 0.2, seki_pass);
+    int seki_pass_trials = seki_pass_iterations;
+    current_pass = 0;
+    if (time_budget_ms > 0) {
+        has_deadline = true;
+        deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget / 2);
+    }
+    Grid seki_pass;
+    {
+        PhaseTimer timer(stats, EstimateStats::SEKI_ROLLOUT);
+        seki_pass = rollout(seki_pass_iterations, player_to_move, false, GridMask(), Grid(), GridMask(), adaptive || warm ? 0.2 : 0, &seki_pass_trials);
+    }
+    GridMask seki;
+    {
+        PhaseTimer timer(stats, EstimateStats::SEKI_SCAN);
+        //seki = scanForSeki(num_iterations, tolerance, seki_pass);
+        seki = scanForSeki(num_iterations, 0.2, seki_pass);
+    }
+
+    /* Give pass1 its own set of rollout streams */
+    seed = mix_seed(seed, 0xffffffff);
 
 #ifndef EMSCRIPTEN
     if (debug) {
         printf("\nSeki pass:\n");
         seki_pass.printInts(" %6d", "      ");
         printf("\nSeki:\n");
-        seki.printInts();
+        seki.grid().printInts();
     }
 #endif
 
     Grid horseshoe_bias;
+    {
+        PhaseTimer timer(stats, EstimateStats::HORSESHOE);
 
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            if (board[p] == 0 && (is_safe_horseshoe(p, BLACK) || is_safe_horseshoe(p, WHITE))) {
-                Vec neighbors ;
-                board.getNeighbors(p, neighbors);
-                //if (debug) { NOTE << p << " was horseshoe" << endl; }
-                for (int i=0; i< neighbors.size; ++i) {
-                    Vec gr = board.group(neighbors[i]);
-                    horseshoe_bias.add(gr, 1);
+        for (int y=0; y < height; ++y) {
+            for (int x=0; x < width; ++x) {
+                Point p(x,y);
+                if (board[p] == 0 && (is_safe_horseshoe(p, BLACK) || is_safe_horseshoe(p, WHITE))) {
+                    Vec neighbors ;
+                    board.getNeighbors(p, neighbors);
+                    //if (debug) { NOTE << p << " was horseshoe" << endl; }
+                    for (int i=0; i< neighbors.size; ++i) {
+                        Vec gr;
+                        components.group(components.id[neighbors[i]], gr);
+                        horseshoe_bias.add(gr, 1);
+                    }
                 }
             }
         }
-    }
 
-    horseshoe_bias *= board;
-    horseshoe_bias *= (num_iterations * (tolerance / 4));
+        horseshoe_bias *= Grid(board);
+        horseshoe_bias *= (num_iterations * (tolerance / 4));
+    }
 
 
     Grid ret;
@@ -130,10 +349,17 @@ Grid Goban::_estimate(Color player_to_move, int num_iterations, float tolerance,
 
     //Grid bias = computeBias(num_iterations, tolerance);
     Grid bias;
-    Grid territory_map = computeTerritory();
-    Grid group_map = computeGroupMap();
-    Grid liberty_map = computeLiberties(group_map);
-    Grid strong_life = computeStrongLife(group_map, territory_map, liberty_map);
+    Grid territory_map;
+    Grid group_map;
+    Grid liberty_map;
+    Grid strong_life;
+    {
+        PhaseTimer timer(stats, EstimateStats::STATIC_MAPS);
+        territory_map = computeTerritory();
+        group_map = computeGroupMap();
+        liberty_map = computeLiberties(group_map);
+        strong_life = computeStrongLife(group_map, territory_map, liberty_map);
+    }
 
     //bias += (seki * board) * (int)(num_iterations * tolerance) * 2;
 
@@ -183,8 +409,24 @@ Grid Goban::_estimate(Color player_to_move, int num_iterations, float tolerance,
     //Grid pass1 = rollout(pass1_iterations, player_to_move, strong_life, bias);
     //pass1 = rollout(pass1_iterations, player_to_move, strong_life, bias);
     //pass1 = rollout(pass1_iterations, player_to_move, true, strong_life, bias, seki);
-    pass1 = rollout(pass1_iterations, player_to_move, true, strong_life, bias, seki);
-    Vec dead = getDead(pass1_iterations, tolerance, pass1);
+    int pass1_trials = pass1_iterations;
+    current_pass = 1;
+    if (time_budget_ms > 0) {
+        deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+    }
+    {
+        PhaseTimer timer(stats, EstimateStats::PASS1);
+        pass1 = rollout(pass1_iterations, player_to_move, true, GridMask(strong_life), bias, seki, adaptive || warm ? tolerance : 0, &pass1_trials);
+    }
+    if (pass_trials) {
+        pass_trials[0] = seki_pass_trials;
+        pass_trials[1] = pass1_trials;
+    }
+    Vec dead;
+    {
+        PhaseTimer timer(stats, EstimateStats::DEAD);
+        dead = getDead(pass1_iterations, tolerance, pass1);
+    }
 
 #ifndef EMSCRIPTEN
     if (debug) {
@@ -200,57 +442,173 @@ Grid Goban::_estimate(Color player_to_move, int num_iterations, float tolerance,
     //board.set(dead, 0);
 
 #ifndef EMSCRIPTEN
-    Grid removed;
-    removed.set(dead, 1);
+    GridMask removed;
+    removed.set(dead);
     if (debug) {
         printf("\nRemoved from pass1:\n");
-        removed.printInts();
+        removed.grid().printInts();
     }
 #endif
 
 
-    /* Create a result board based off of how many times each spot was which color. */
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            /* If we're pretty confident we know who the spot belongs to, mark it */
-            if (pass1[y][x] > num_iterations * tolerance) {
-                ret[y][x] = 1;
-            } else if (pass1[y][x] < num_iterations * -tolerance) {
-                ret[y][x] = -1;
-            /* if that fails, it's probably just dame */
-            } else {
-                if (board[y][x]) {
-                    if (abs(pass1[y][x]) < num_iterations * tolerance / 3) {
-                        ret[y][x] = 0;
+    {
+        PhaseTimer timer(stats, EstimateStats::HOLE_FILL);
+
+        /* Create a result board based off of how many times each spot was which color. */
+        for (int y=0; y < height; ++y) {
+            for (int x=0; x < width; ++x) {
+                Point p(x,y);
+                /* If we're pretty confident we know who the spot belongs to, mark it */
+                if (pass1[y][x] > num_iterations * tolerance) {
+                    ret[y][x] = 1;
+                } else if (pass1[y][x] < num_iterations * -tolerance) {
+                    ret[y][x] = -1;
+                /* if that fails, it's probably just dame */
+                } else {
+                    if (board[y][x]) {
+                        if (abs(pass1[y][x]) < num_iterations * tolerance / 3) {
+                            ret[y][x] = 0;
+                        } else {
+                            ret[y][x] = pass1[y][x] > 0 ? 1 : -1;
+                        }
                     } else {
-                        ret[y][x] = pass1[y][x] > 0 ? 1 : -1;
+                        ret[y][x] = 0;
+                    }
+                }
+            }
+        }
+
+
+        /* TODO: Foreach hole, if it can only reach one color, color it that */
+        for (int y=0; y < height; ++y) {
+            for (int x=0; x < width; ++x) {
+                Point p(x,y);
+                if (ret[p] == 0) {
+                    int c = components.id[p];
+                    const BoardAnalysis::Component &comp = components[c];
+                    const Point *neighbors = components.neighbors_of(c);
+                    bool black = false;
+                    bool white = false;
+                    for (int i=0; i < comp.num_neighbors; ++i) {
+                        black |= ret[neighbors[i]] == BLACK;
+                        white |= ret[neighbors[i]] == WHITE;
+                    }
+
+                    int color = !white ? BLACK : !black ? WHITE : EMPTY;
+                    if (color != EMPTY) {
+                        const Point *group = components.points_of(c);
+                        for (int i=0; i < comp.num_points; ++i) {
+                            ret[group[i]] = color;
+                        }
                     }
-                } else {
-                    ret[y][x] = 0;
                 }
             }
         }
     }
 
+    if (prior) {
+        prior->board = given;
+        prior->filled = board;
+        prior->num_iterations = num_iterations;
+        prior->tolerance = tolerance;
+        prior->seed = given_seed;
+        prior->valid = true;
+    }
 
-    /* TODO: Foreach hole, if it can only reach one color, color it that */
+    analysis = NULL;
+    return ret;
+}
+int Goban::warm_start(const ColorGrid &given) {
+    const BoardAnalysis &components = board_analysis();
+    Grid distance(width, height);
+    Point queue[MAX_VEC_SIZE];
+    int head = 0;
+    int tail = 0;
+
+    focus = GridMask(width, height);
+    distance.clear(-1);
+
+    /* Every changed point, and every string on or next to one, whose
+     * liberties may have changed with it */
     for (int y=0; y < height; ++y) {
         for (int x=0; x < width; ++x) {
-            Vec group, neighbors;
-            Point p(x,y);
-            if (ret[p] == 0) {
-                board.groupAndNeighbors(p, group, neighbors);
-                if (ret.allNotEqualTo(neighbors, WHITE)) {
-                    ret.set(group, BLACK);
-                } else if (ret.allNotEqualTo(neighbors, BLACK)) {
-                    ret.set(group, WHITE);
+            if (given[y][x] == prior->board[y][x] && board[y][x] == prior->filled[y][x]) {
+                continue;
+            }
+
+            Point p(x, y);
+            Vec around;
+            board.getNeighbors(p, around);
+            around.push(p);
+            for (int i=0; i < around.size; ++i) {
+                int c = components.id[around[i]];
+                if (components[c].color == EMPTY) {
+                    continue;
                 }
+                const Point *group = components.points_of(c);
+                for (int j=0; j < components[c].num_points; ++j) {
+                    if (distance[group[j]] < 0) {
+                        distance[group[j]] = 0;
+                        queue[tail++] = group[j];
+                    }
+                }
+            }
+            if (distance[p] < 0) {
+                distance[p] = 0;
+                queue[tail++] = p;
             }
         }
     }
 
-    return ret;
+    /* and the empty points within reach of those */
+    while (head < tail) {
+        Point p = queue[head++];
+        focus.set(p);
+        if (distance[p] == INCREMENTAL_REACH) {
+            continue;
+        }
+
+        Vec neighbors;
+        board.getNeighbors(p, neighbors);
+        for (int i=0; i < neighbors.size; ++i) {
+            const Point &n = neighbors[i];
+            if (board[n] == EMPTY && distance[n] < 0) {
+                distance[n] = distance[p] + 1;
+                queue[tail++] = n;
+            }
+        }
+    }
+    return tail;
+}
+void Goban::blend_prior(Grid &counts, int num_trials) const {
+    Grid &before = prior->counts[current_pass];
+    Grid &weight = prior->weight[current_pass];
+
+    for (int y=0; y < height; ++y) {
+        for (int x=0; x < width; ++x) {
+            if (!warm || focus.get(x, y)) {
+                weight[y][x] = num_trials;
+            } else if (num_trials == 0) {
+                counts[y][x] = before[y][x];
+            } else {
+                /* Both are scaled to num_iterations, so weigh them by the
+                 * trials behind them. The prior never counts for more than
+                 * a full run, so older positions fade out. */
+                long long w = MIN(weight[y][x], prior->num_iterations);
+                counts[y][x] = (int)(((long long)before[y][x] * w + (long long)counts[y][x] * num_trials) / (w + num_trials));
+                weight[y][x] = (int)(w + num_trials);
+            }
+        }
+    }
+    before = counts;
+}
+const BoardAnalysis& Goban::board_analysis() const {
+    if (analysis) {
+        return *analysis;
+    }
+    BoardAnalysis &scratch = EstimateWorkspace::local().scratch_analysis;
+    scratch.build(board);
+    return scratch;
 }
 
 Grid Goban::biasLibertyMap(int num_iterations, float tolerance, const Grid &liberty_map) const {
@@ -323,70 +681,65 @@ Grid Goban::biasLikelyDead(int num_iterations, float tolerance, const Grid &libe
 
     return ret;
 }
-Grid Goban::scanForSeki(int num_iterations, float tolerance, const Grid &rollout_pass) const {
-    Grid seki;
-    Grid visited;
+GridMask Goban::scanForSeki(int num_iterations, float tolerance, const Grid &rollout_pass) const {
+    GridMask seki;
+    const BoardAnalysis &components = board_analysis();
 
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            Vec group, neighbors;
-            
-            if (visited[p]) {
-                continue;
-            }
+    for (int c=0; c < components.num_components; ++c) {
+        const BoardAnalysis::Component &comp = components[c];
+        Vec group, neighbors;
 
-            board.groupAndNeighbors(p, group, neighbors);
-            visited.set(group, 1);
+        if (comp.color == EMPTY) {
+            continue;
+        }
 
-            for (int color : { BLACK , WHITE }) {
-                int other = - color;
+        components.group(c, group);
+        components.neighbors(c, neighbors);
 
-                if (board[p] == color && rollout_pass.allAbsLTE(group, num_iterations * tolerance)) {
-                    Vec neighboring = board.match(neighbors, other);
-                    int my_liberties = board.countEqual(neighbors, EMPTY);
+        for (int color : { BLACK , WHITE }) {
+            int other = - color;
 
-                    /* If it is questionable that we are dead, and we are neighboring another group
-                     * that is questionably dead - consider ourselves in seki if both groups have the
-                     * same number of liberties. This is not a true seki detection and doesn't work
-                     * in all possible cases, however it's pretty reasonable. */
-                    if (rollout_pass.anyAbsLTE(neighboring, num_iterations * tolerance)) {
-                        int in_seki = true;
+            if (comp.color == color && rollout_pass.allAbsLTE(group, num_iterations * tolerance)) {
+                Vec neighboring = board.match(neighbors, other);
+                int my_liberties = comp.liberties;
 
-                        for (int i=0; i < neighboring.size; ++i) {
+                /* If it is questionable that we are dead, and we are neighboring another group
+                 * that is questionably dead - consider ourselves in seki if both groups have the
+                 * same number of liberties. This is not a true seki detection and doesn't work
+                 * in all possible cases, however it's pretty reasonable. */
+                if (rollout_pass.anyAbsLTE(neighboring, num_iterations * tolerance)) {
+                    int in_seki = true;
 
-                            if (abs(rollout_pass[neighboring[i]]) < num_iterations * tolerance) {
-                                Vec neighbor_group, neighbor_neighbors;
-                                board.groupAndNeighbors(neighboring[i], neighbor_group, neighbor_neighbors);
+                    for (int i=0; i < neighboring.size; ++i) {
 
-                                int neighbor_liberties = board.countEqual(neighbor_neighbors, EMPTY);
-                                if (neighbor_liberties != my_liberties) {
-                                    in_seki = false;
-                                }
+                        if (abs(rollout_pass[neighboring[i]]) < num_iterations * tolerance) {
+                            int neighbor_liberties = components.at(neighboring[i]).liberties;
+                            if (neighbor_liberties != my_liberties) {
+                                in_seki = false;
                             }
                         }
+                    }
 
-                        if (in_seki) {
-                            seki.set(group, 1);
-                            Vec territory = board.match(neighbors, EMPTY);
-                            seki.set(territory, 1);
-                        }
+                    if (in_seki) {
+                        seki.set(group);
+                        Vec territory = board.match(neighbors, EMPTY);
+                        seki.set(territory);
                     }
+                }
 
-                    /*
+                /*
 
-                    if (rollout_pass.anyAbsLTE(neighboring, num_iterations * tolerance)
-                        && board.countEqual(neighbors, EMPTY) <= 2
-                        //&& !rollout_pass.anyAbsGTE(neighboring, num_iterations * tolerance)
-                        )
-                    {
-                        seki.set(group, 1);
+                if (rollout_pass.anyAbsLTE(neighboring, num_iterations * tolerance)
+                    && board.countEqual(neighbors, EMPTY) <= 2
+                    //&& !rollout_pass.anyAbsGTE(neighboring, num_iterations * tolerance)
+                    )
+                {
+                    seki.set(group, 1);
 
-                        Vec territory = board.match(neighbors, EMPTY);
-                        seki.set(territory, 1);
-                    }
-                    */
+                    Vec territory = board.match(neighbors, EMPTY);
+                    seki.set(territory, 1);
                 }
+                */
             }
         }
     }
@@ -394,71 +747,69 @@ Grid Goban::scanForSeki(int num_iterations, float tolerance, const Grid &rollout
     return seki;
 }
 
-Grid Goban::rollout(int num_iterations, Color player_to_move, bool pullup_life_based_on_neigboring_territory, const Grid &life_map, const Grid &bias, const Grid &seki) const {
+Grid Goban::rollout(int num_iterations, Color player_to_move, bool pullup_life_based_on_neigboring_territory, const GridMask &life_map, const Grid &bias, const GridMask &seki, float stop_tolerance, int *trials_used) const {
     Grid ret = bias;
+    Grid counts(width, height);
+    int num_trials;
+
+    /* The usual board sizes get a playout board with their geometry
+     * compiled in, anything else the generic one */
+    if (warm && !focus.any()) {
+        /* a warm start with nothing to redo */
+        num_trials = 0;
+    } else if (width == 9 && height == 9) {
+        num_trials = rollout_trials<9>(num_iterations, player_to_move, life_map, bias, seki, stop_tolerance, counts);
+    } else if (width == 13 && height == 13) {
+        num_trials = rollout_trials<13>(num_iterations, player_to_move, life_map, bias, seki, stop_tolerance, counts);
+    } else if (width == 19 && height == 19) {
+        num_trials = rollout_trials<19>(num_iterations, player_to_move, life_map, bias, seki, stop_tolerance, counts);
+    } else {
+        num_trials = rollout_trials<0>(num_iterations, player_to_move, life_map, bias, seki, stop_tolerance, counts);
+    }
 
-    for (int i=0; i < num_iterations; ++i) {
-        /* Play out a random game */
-        Goban t(*this);
-
-        t.play_out_position(player_to_move, life_map, seki);
-        
-        //t.board.print();
-
-        /* fill in territory */
+    if (num_trials > 0 && num_trials < num_iterations) {
         for (int y=0; y < height; ++y) {
             for (int x=0; x < width; ++x) {
-                Point p(x,y);
-                if (t[p] == 0) {
-                    if (t.is_territory(p, BLACK)) {
-                        t.fill_territory(p, BLACK);
-                    }
-                    if (t.is_territory(p, WHITE)) {
-                        t.fill_territory(p, WHITE);
-                    }
-                }
+                counts[y][x] = (int)((long long)counts[y][x] * num_iterations / num_trials);
             }
         }
+    }
 
-        /* track how many times each spot was white or black */
-        for (int y=0; y < height; ++y) {
-            for (int x=0; x < width; ++x) {
-                ret[y][x] += t.board[y][x];
-            }
-        }
+    if (trials_used) {
+        *trials_used = num_trials;
+    }
+    if (prior) {
+        blend_prior(counts, num_trials);
     }
+    ret += counts;
 
 
     /* For each stone group, find the maximal track counter and set
      * all stones in that group to that level */
     {
-        Grid visited(width, height);
-
-        for (int y=0; y < height; ++y) {
-            for (int x=0; x < width; ++x) {
-                Point p(x,y);
-
-                if (!visited[p] && board[p]) {
-                    Vec group, neighbors;
-                    board.groupAndNeighbors(p, group, neighbors);
-                    int minmax = ret.minmax(group);
-                    visited.set(group, 1);
+        const BoardAnalysis &components = board_analysis();
 
+        for (int c=0; c < components.num_components; ++c) {
+            if (components[c].color != EMPTY) {
+                Vec group, neighbors;
+                components.group(c, group);
+                components.neighbors(c, neighbors);
+                int minmax = ret.minmax(group);
 
-                    if (pullup_life_based_on_neigboring_territory) {
-                        /* If we are adjacent to any territory which is a higher
-                         * value than ourselves, set ourselves to that value */
-                        if (minmax < 0) {
-                            minmax = MIN(ret.min(neighbors), minmax);
-                        }
 
-                        if (minmax > 0) {
-                            minmax = MAX(ret.max(neighbors), minmax);
-                        }
+                if (pullup_life_based_on_neigboring_territory) {
+                    /* If we are adjacent to any territory which is a higher
+                     * value than ourselves, set ourselves to that value */
+                    if (minmax < 0) {
+                        minmax = MIN(ret.min(neighbors), minmax);
                     }
 
-                    ret.set(group, minmax);
+                    if (minmax > 0) {
+                        minmax = MAX(ret.max(neighbors), minmax);
+                    }
                 }
+
+                ret.set(group, minmax);
             }
         }
     }
@@ -468,6 +819,165 @@ Grid Goban::rollout(int num_iterations, Color player_to_move, bool pullup_life_b
     //return ret + bias;
     return ret;
 }
+template<int SIZE>
+int Goban::rollout_trials(int num_iterations, Color player_to_move, const GridMask &life_map, const Grid &bias, const GridMask &seki, float stop_tolerance, Grid &counts) const {
+    /* The string state of the starting position is worked out once, every
+     * trial then starts from a plain copy of it. */
+    TPlayoutBoard<SIZE> initial(width, height);
+    initial.load(board);
+
+    int num_trials = num_iterations;
+    int max_trials = warm ? MAX(1, num_iterations / INCREMENTAL_TRIAL_SHARE) : num_iterations;
+
+    if ((stop_tolerance > 0 || has_deadline) && num_iterations > ROLLOUT_FIRST_BATCH) {
+        /* Batches always end on a chunk boundary, so unless the deadline
+         * cuts one short the trials played are exactly the first num_trials
+         * of the fixed length run. */
+        num_trials = 0;
+        int batch_end = ROLLOUT_FIRST_BATCH;
+        while (num_trials < max_trials) {
+            batch_end = MIN(batch_end, max_trials);
+            int played = play_rollouts(num_trials, batch_end, player_to_move, life_map, seki, initial, counts);
+            bool cut_short = num_trials + played < batch_end;
+            num_trials += played;
+
+            if (cut_short || past_deadline()) {
+                break;
+            }
+            if (stop_tolerance > 0 && rollouts_settled(counts, num_trials, num_iterations, stop_tolerance, bias)) {
+                break;
+            }
+            batch_end *= 2;
+        }
+    } else {
+        num_trials = play_rollouts(0, max_trials, player_to_move, life_map, seki, initial, counts);
+    }
+
+    return num_trials;
+}
+template<int SIZE>
+int Goban::play_rollouts(int first_trial, int end_trial, Color player_to_move, const GridMask &life_map, const GridMask &seki, const TPlayoutBoard<SIZE> &initial, Grid &counts) const {
+    int first_chunk = first_trial / ROLLOUT_CHUNK_SIZE;
+    int num_chunks = (end_trial + ROLLOUT_CHUNK_SIZE - 1) / ROLLOUT_CHUNK_SIZE - first_chunk;
+    int num_workers = rollout_thread_count(num_chunks);
+
+    /* Each worker gets its own playout board and ownership grid, the grids
+     * are summed afterwards. Integer sums don't care about ordering, so the
+     * result is the same no matter how the chunks were spread out. Both
+     * come from this thread's workspace, as do the workers' counters, so
+     * batches after the first don't allocate them again. */
+    EstimateWorkspace            &workspace = EstimateWorkspace::local();
+    vector<TPlayoutBoard<SIZE> > &playouts = workspace.playouts<SIZE>(num_workers, width, height);
+    vector<Grid>                 &partials = workspace.partials(num_workers, width, height);
+    vector<PhaseStats>           &played = workspace.counters(num_workers);
+
+#ifdef USE_THREADS
+    vector<thread> threads;
+    for (int w=1; w < num_workers; ++w) {
+        threads.push_back(thread(&Goban::rollout_worker<SIZE>, this, w, num_workers, first_chunk, end_trial, player_to_move, std::cref(life_map), std::cref(seki), std::cref(initial), std::ref(playouts[w]), std::ref(partials[w]), std::ref(played[w])));
+    }
+#endif
+    rollout_worker(0, num_workers, first_chunk, end_trial, player_to_move, life_map, seki, initial, playouts[0], partials[0], played[0]);
+#ifdef USE_THREADS
+    for (size_t i=0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+#endif
+
+    PhaseStats total;
+    for (int w=0; w < num_workers; ++w) {
+        counts += partials[w];
+        total += played[w];
+    }
+    if (stats) {
+        stats->phases[current_pass == 0 ? EstimateStats::SEKI_ROLLOUT : EstimateStats::PASS1] += total;
+    }
+    return (int)total.playouts;
+}
+/* True if the interval mean +- eps could put the point on either side of
+ * the threshold t (or -t, whichever is nearer), ignoring the zone within
+ * margin of t where even a full length run is a coin flip. */
+static inline bool straddles(double mean, double eps, double t, double margin) {
+    if (mean < 0) {
+        t = -t;
+    }
+    return mean - eps < t - margin && mean + eps > t + margin;
+}
+bool Goban::rollouts_settled(const Grid &counts, int num_trials, int num_iterations, float tolerance, const Grid &bias) const {
+    /* (N - n) / (N n) for the full run of N trials, n of them played */
+    double left = (double)MAX(0, num_iterations - num_trials) / ((double)num_iterations * num_trials);
+
+    for (int y=0; y < height; ++y) {
+        for (int x=0; x < width; ++x) {
+            /* A warm start only waits for the points it has to redo, and
+             * only the stones of the seki pass are looked at afterwards,
+             * see scanForSeki */
+            if ((warm && !focus.get(x, y)) || (current_pass == 0 && !board[y][x])) {
+                continue;
+            }
+
+            /* Trials score a point -1, 0 or +1, so with mean m its variance is
+             * at most 1 - m^2. The floor keeps a run of identical outcomes from
+             * giving a zero width interval, as in the Wilson score interval. */
+            double mean = (double)counts[y][x] / num_trials;
+            double var = MAX(1 - mean * mean, 4.0 / num_trials);
+
+            /* eps bounds how far the trials left can still move the mean of
+             * the full run from the mean so far. margin is the full run's
+             * own interval, which end of it a point that near a threshold
+             * lands on is down to the seed. So at worst this settles after
+             * half of the trials. */
+            double eps = ROLLOUT_STOP_Z * sqrt(var * left);
+            double margin = ROLLOUT_STOP_Z * sqrt(var / num_iterations);
+
+            mean += (double)bias[y][x] / num_iterations;
+            if (straddles(mean, eps, tolerance, margin)) {
+                return false;
+            }
+            if (board[y][x] && straddles(mean, eps, tolerance / 3, margin)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+int Goban::rollout_thread_count(int num_chunks) const {
+#ifdef USE_THREADS
+    int n = num_threads;
+    if (n <= 0) {
+        n = (int)thread::hardware_concurrency();
+    }
+    return MAX(1, MIN(n, num_chunks));
+#else
+    return 1;
+#endif
+}
+template<int SIZE>
+void Goban::rollout_worker(int worker, int num_workers, int first_chunk, int end_trial, Color player_to_move, const GridMask &life_map, const GridMask &seki, const TPlayoutBoard<SIZE> &initial, TPlayoutBoard<SIZE> &playout, Grid &out, PhaseStats &played) const {
+    playout.counters = PhaseStats();
+    PlayoutRandom rng;
+
+    for (int chunk=first_chunk + worker; chunk * ROLLOUT_CHUNK_SIZE < end_trial; chunk += num_workers) {
+        /* the first batch always gets played so there is something to go on */
+        if (chunk * ROLLOUT_CHUNK_SIZE >= ROLLOUT_FIRST_BATCH && past_deadline()) {
+            break;
+        }
+        int end = MIN(end_trial, (chunk + 1) * ROLLOUT_CHUNK_SIZE);
+
+        for (int i=chunk * ROLLOUT_CHUNK_SIZE; i < end; ++i) {
+            rng.reseed(seed, i);
+
+            /* Play out a random game, fill in territory and track how many
+             * times each spot was white or black */
+            playout.reset(initial);
+            playout.play_out_position(player_to_move, life_map, seki, rng);
+            playout.accumulate_score(out);
+            ++played.playouts;
+        }
+    }
+
+    played += playout.counters;
+}
 Grid Goban::computeBias(int num_iterations, float tolerance) {
     Grid bias(width, height);
     /* Bias our scoring towards trusting the player's area is theirs */
@@ -498,124 +1008,111 @@ Grid Goban::computeBias(int num_iterations, float tolerance) {
 }
 Grid Goban::computeGroupMap() const{
     Grid ret(width, height);
-    int cur_group = 1;
+    const BoardAnalysis &components = board_analysis();
 
     for (int y=0; y < height; ++y) {
         for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            if (ret[p] == 0) {
-                board.traceGroup(p, ret, cur_group++);
-            }
+            ret[y][x] = components.id[y][x] + 1;
         }
     }
 
     return ret;
 }
-Grid Goban::computeTerritory() {
+Grid Goban::computeTerritory() const {
     Grid ret(width, height);
+    const BoardAnalysis &components = board_analysis();
 
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            if (ret[p]) {
-                continue;
-            }
+    for (int c=0; c < components.num_components; ++c) {
+        const BoardAnalysis::Component &comp = components[c];
 
-            Vec group, neighbors;
-            if (board[p] == 0 && is_territory(p, BLACK)) {
-                board.groupAndNeighbors(p, group, neighbors);
-                ret.set(group, group.size * BLACK);
-            }
-            if (board[p] == 0 && is_territory(p, WHITE)) {
-                board.groupAndNeighbors(p, group, neighbors);
-                ret.set(group, group.size * WHITE);
-            }
+        /* empty and bordered by one color only */
+        if (comp.color == EMPTY && (comp.borders == 1 || comp.borders == 2)) {
+            Vec group;
+            components.group(c, group);
+            ret.set(group, group.size * (comp.borders == 1 ? BLACK : WHITE));
         }
     }
 
     return ret;
 }
-Grid Goban::computeLiberties(const Grid &group_map) const {
+Grid Goban::computeLiberties(const Grid &/*group_map*/) const {
     Grid ret(width, height);
-    Grid visited(width, height);
-
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            if (visited[p]) { 
-                continue;
-            }
-
-            Vec group;
-            Vec neighbors;
-            board.groupAndNeighbors(p, group, neighbors);
-            visited.set(group, 1);
-
-
-            int liberty_count = 0;
-            if ((*this)[p] == 0) {
-                /* sum of all ajacent black - all ajacent white */
-                for (int i=0; i < neighbors.size; ++i) {
-                    liberty_count += (*this)[neighbors[i]];
-                }
-            } else {
-                /* liberties of stone group */
-                for (int i=0; i < neighbors.size; ++i) {
-                    if ((*this)[neighbors[i]] == 0) {
-                        liberty_count += (*this)[p];
-                    }
-                }
+    const BoardAnalysis &components = board_analysis();
+
+    for (int c=0; c < components.num_components; ++c) {
+        const BoardAnalysis::Component &comp = components[c];
+        Vec group;
+        components.group(c, group);
+
+        int liberty_count = 0;
+        if (comp.color == EMPTY) {
+            /* sum of all ajacent black - all ajacent white */
+            const Point *neighbors = components.neighbors_of(c);
+            for (int i=0; i < comp.num_neighbors; ++i) {
+                liberty_count += (*this)[neighbors[i]];
             }
-
-            ret.set(group, liberty_count);
+        } else {
+            /* liberties of stone group */
+            liberty_count = comp.liberties * comp.color;
         }
+
+        ret.set(group, liberty_count);
     }
 
     return ret;
 }
-Grid Goban::computeStrongLife(const Grid &groups, const Grid &territory, const Grid &liberties) const {
+Grid Goban::computeStrongLife(const Grid &/*groups*/, const Grid &territory, const Grid &/*liberties*/) const {
     Grid ret(width, height);
-    Grid visited(width, height);
-
-    Grid unified_territory_and_stones(width, height);
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            unified_territory_and_stones[p] = board[p] == 0 ? (territory[p] <= -1 ? -1 : territory[p] >= 1 ? 1 : 0) : board[p];
-        }
+    const BoardAnalysis &components = board_analysis();
+
+    /* Territory counts as stones of its owner, so strings join up with
+     * the territory they border into larger groups */
+    int unified[MAX_VEC_SIZE];
+    int visited[MAX_VEC_SIZE];
+    for (int c=0; c < components.num_components; ++c) {
+        const BoardAnalysis::Component &comp = components[c];
+        int t = territory[components.points_of(c)[0]];
+        unified[c] = comp.color != EMPTY ? comp.color : (t <= -1 ? -1 : t >= 1 ? 1 : 0);
+        visited[c] = 0;
     }
 
+    int members[MAX_VEC_SIZE];
+    for (int c=0; c < components.num_components; ++c) {
+        if (visited[c]) {
+            continue;
+        }
 
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            if (visited[p]) { 
-                continue;
+        int num_members = 0;
+        members[num_members++] = c;
+        visited[c] = 1;
+        for (int i=0; i < num_members; ++i) {
+            const int *adjacent = components.adjacent_to(members[i]);
+            for (int j=0; j < components[members[i]].num_adjacent; ++j) {
+                int a = adjacent[j];
+                if (!visited[a] && unified[a] == unified[c]) {
+                    visited[a] = 1;
+                    members[num_members++] = a;
+                }
             }
+        }
 
-            Vec group;
-            Vec neighbors;
-            unified_territory_and_stones.groupAndNeighbors(p, group, neighbors);
-
-            int num_eyes = 0;
-            int num_territory = 0;
-            for (int i=0; i < group.size; ++i) {
-                if (visited[group[i]]) { 
-                    continue;
-                }
-                if (territory[group[i]]) {
-                    Vec territory_group; 
-                    Vec territory_neighbors;
-                    board.groupAndNeighbors(group[i], territory_group, territory_neighbors);
-                    visited.set(territory_group, 1);
-                    num_eyes += 1;
-                    num_territory += territory_group.size;
-                }
+        int num_eyes = 0;
+        int num_territory = 0;
+        for (int i=0; i < num_members; ++i) {
+            const BoardAnalysis::Component &comp = components[members[i]];
+            if (comp.color == EMPTY && territory[components.points_of(members[i])[0]]) {
+                num_eyes += 1;
+                num_territory += comp.num_points;
             }
+        }
 
-            visited.set(group, 1);
-            if (num_eyes >= 2 || num_territory >= 5) {
-                ret.set(group, num_territory);
+        if (num_eyes >= 2 || num_territory >= 5) {
+            for (int i=0; i < num_members; ++i) {
+                const BoardAnalysis::Component &comp = components[members[i]];
+                const Point *group = components.points_of(members[i]);
+                for (int j=0; j < comp.num_points; ++j) {
+                    ret[group[j]] = num_territory;
+                }
             }
         }
     }
@@ -655,21 +1152,19 @@ Vec Goban::getFalseEyes() const {
         for (int x=0; x < width; ++x) {
             Point p(x,y);
             if (at(p) == 0) {
-                Vec neighbors;
-                Vec corners;
-                board.getNeighbors(p, neighbors);
-                board.getCornerPoints(p, corners);
+                int nbr, corner;
+                pattern_codes(board, p, nbr, corner);
 
-                if (board.getMinLibertiesOfSurroundingGroups(p) > 1) {
+                /* surrounded by one color with enough of the other in the corners */
+                if (!(pattern_eye_shape[nbr] & pattern_corner_risk[corner])) {
                     continue;
                 }
 
-                if (board.allEqualTo(neighbors, BLACK) && board.countEqual(corners, WHITE) >= (corners.size>>1)) {
-                    false_eyes.push(p);
-                }
-                else if (board.allEqualTo(neighbors, WHITE) && board.countEqual(corners, BLACK) >= (corners.size>>1)) {
-                    false_eyes.push(p);
+                if (board.getMinLibertiesOfSurroundingGroups(p) > 1) {
+                    continue;
                 }
+
+                false_eyes.push(p);
             }
         }
     }
@@ -693,6 +1188,7 @@ bool Goban::is_territory(Point pt, Color player) {
     int         visited_counter = ++last_visited_counter;
     int         adjacent_player_stones = 0;
 
+    ++flood_fill_count;
     tocheck.push(pt);
     global_visited[pt] = visited_counter;
 
@@ -722,6 +1218,7 @@ void Goban::fill_territory(Point pt, Color player) {
     Vec neighbors;
     int         visited_counter = ++last_visited_counter;
 
+    ++flood_fill_count;
     tocheck.push(pt);
     global_visited[pt] = visited_counter;
 
@@ -739,70 +1236,12 @@ void Goban::fill_territory(Point pt, Color player) {
         }
     }
 }
-void Goban::play_out_position(Color player_to_move, const Grid &life_map, const Grid &seki) {
-    do_ko_check = 0;
-    possible_ko = Point(-1,-1);
-
-    Vec possible_moves;
-    Vec illegal_moves;
-
-    for (int y=0; y < height; ++y) {
-        for (int x=0; x < width; ++x) {
-            Point p(x,y);
-            if (board[p] == 0 && seki[p] == 0 && life_map[p] == 0) {
-                possible_moves.push(Point(x,y));
-            }
-        }
-    }
-
-    int sanity = 1000;
-    int passed = false;
-    while (possible_moves.size > 0 && --sanity > 0) {
-        int move_idx = rand() % possible_moves.size;
-        Point mv(possible_moves[move_idx]);
+void Goban::play_out_position(Color player_to_move, const GridMask &life_map, const GridMask &seki) {
+    PlayoutBoard playout(width, height);
 
-        //if (is_eye(mv, player_to_move) || would_self_atari(mv, player_to_move)) { /* checking for self atari prevents snapback, which messes up a lot of games */
-        if (is_eye(mv, player_to_move)) {
-            illegal_moves.push(possible_moves.remove(move_idx));
-
-            if (possible_moves.size == 0) {
-                if (passed) {
-                    break;
-                }
-                passed = true;
-                possible_moves += illegal_moves;
-                illegal_moves.size = 0;
-                player_to_move = (Color)-player_to_move;
-            }
-            continue;
-        }
-
-
-        int result = place_and_remove(mv, player_to_move, possible_moves);
-        if (result == OK) {
-            passed = false;
-            possible_moves.remove(move_idx);
-            player_to_move = (Color)-player_to_move;
-            possible_moves += illegal_moves;
-            illegal_moves.size = 0;
-            continue;
-        }
-        else if (result == ILLEGAL) {
-            illegal_moves.push(possible_moves.remove(move_idx));
-
-            if (possible_moves.size == 0) {
-                if (passed) {
-                    break;
-                }
-                passed = true;
-                possible_moves += illegal_moves;
-                illegal_moves.size = 0;
-                player_to_move = (Color)-player_to_move;
-            }
-
-            continue;
-        }
-    }
+    playout.load(board);
+    playout.play_out_position(player_to_move, life_map, seki, rand);
+    playout.store(board);
 }
 Goban::Result Goban::place_and_remove(Point move, Color player, Vec &possible_moves) {
     if (do_ko_check) {
@@ -855,6 +1294,7 @@ bool Goban::has_liberties(const Point &pt) {
     int my_color           = (*this)[pt];
     int my_visited_counter = ++last_visited_counter;
 
+    ++flood_fill_count;
     tocheck.push(pt);
     global_visited[pt] = my_visited_counter;
 
@@ -919,14 +1359,15 @@ bool Goban::has_liberties(const Point &pt) {
     return false;
 }
 int  Goban::remove_group(Point move, Vec &possible_moves) {
-    Grid        visited;
     Vec         tocheck;
     Vec         neighbors;
     int         n_removed = 0;
     int         my_color  = (*this)[move];
+    int         visited_counter = ++last_visited_counter;
 
+    ++flood_fill_count;
     tocheck.push(move);
-    visited[move] = true;
+    global_visited[move] = visited_counter;
 
     while (tocheck.size) {
         Point p = tocheck.remove(0);
@@ -939,8 +1380,8 @@ int  Goban::remove_group(Point move, Vec &possible_moves) {
 
         for (int i=0; i < neighbors.size; ++i) {
             Point neighbor = neighbors[i];
-            if (visited[neighbor]) continue;
-            visited[neighbor] = true;
+            if (global_visited[neighbor] == visited_counter) continue;
+            global_visited[neighbor] = visited_counter;
 
             int c = (*this)[neighbor];
             if (c == my_color) {
@@ -984,34 +1425,27 @@ bool Goban::would_self_atari(Point pt, Color player) const {
     return false;
 }
 bool Goban::is_eye(Point pt, Color player) const {
-    if ((pt.x == 0        || board[pt.y][pt.x-1] == player) &&
-        (pt.x == width-1  || board[pt.y][pt.x+1] == player) &&
-        (pt.y == 0        || board[pt.y-1][pt.x] == player) &&
-        (pt.y == height-1 || board[pt.y+1][pt.x] == player))
-    {
-#if 1
-        Vec corners;
-        board.getCornerPoints(pt, corners);
-        if (board.countEqual(corners, -player) >= (corners.size >> 1) && board.getMinLibertiesOfSurroundingGroups(pt) <= 1) {
+    int nbr, corner;
+    pattern_codes(board, pt, nbr, corner);
+    int side = pattern_side(player);
+
+    if (pattern_eye_shape[nbr] & side) {
+        if ((pattern_corner_risk[corner] & side) && board.getMinLibertiesOfSurroundingGroups(pt) <= 1) {
             /* False eye */
             return false;
         }
-#endif
 
         return true;
     }
     return false;
 }
 bool Goban::is_safe_horseshoe(Point pt, Color player) const {
-    Vec neighbors;
-    board.getNeighbors(pt, neighbors);
-
-
-    if (board.countEqual(neighbors, player) >= neighbors.size - 1 && board.countEqual(neighbors, -player) == 0) {
-        Vec corners;
-        board.getCornerPoints(pt, corners);
+    int nbr, corner;
+    pattern_codes(board, pt, nbr, corner);
+    int side = pattern_side(player);
 
-        if (board.countEqual(corners, -player) >= (corners.size >> 1) && board.getMinLibertiesOfSurroundingGroups(pt) <= 1) {
+    if (pattern_horseshoe_shape[nbr] & side) {
+        if ((pattern_corner_risk[corner] & side) && board.getMinLibertiesOfSurroundingGroups(pt) <= 1) {
             /* Looks like a false eye, or very close to it */
             return false;
         }
@@ -4,9 +4,15 @@
 #include "Point.h"
 #include "Vec.h"
 #include "Grid.h"
-#ifdef USE_THREADS
-#  include <random>
-#endif
+#include "PlayoutBoard.h"
+#include "EstimateCache.h"
+#include "EstimateStats.h"
+#include "Random.h"
+#include "Pattern3x3.h"
+#include "BoardAnalysis.h"
+#include "EstimateWorkspace.h"
+#include "EstimatePrior.h"
+#include <chrono>
 
 class Goban {
     public:
@@ -18,33 +24,92 @@ class Goban {
     public:
         int       width;
         int       height;
-        Grid      board;
+        ColorGrid board;
         int       do_ko_check;
         Point     possible_ko;
 
         Grid      global_visited;
         int       last_visited_counter;
 
-#ifdef USE_THREADS
-        std::mt19937 rand;
-#endif
+        /* Number of worker threads rollout() splits its trials across, 0
+         * means one per available core. */
+        int       num_threads;
+
+        /* Base seed for rollouts, ROLLOUT_DEFAULT_SEED unless set. Every
+         * trial draws from its own PlayoutRandom stream (seed, trial index),
+         * so rollout results only depend on the seed and the trial count,
+         * not on num_threads. */
+        unsigned  seed;
+
+        /* Let estimate() stop each rollout pass early, once the trials left
+         * could no longer move any point's ownership confidently across a
+         * tolerance threshold. The trial count passed in becomes an upper
+         * bound. */
+        bool      adaptive;
+
+        /* Serve repeated estimate() calls from EstimateCache::instance() */
+        bool      use_cache;
+
+        /* Generator for play_out_position() */
+        PlayoutRandom rand;
 
         Goban(int width, int height);
         Goban(const Goban &other);
         void setBoardSize(int width, int height); 
-        Grid estimate(Color player_to_move, int trials, float tolerance, bool debug) const;
+        /* Estimates territory and dead stones. If stats is given it is
+         * filled with the time and work each phase of the estimate took,
+         * or left empty on a cache hit. */
+        Grid estimate(Color player_to_move, int trials, float tolerance, bool debug, int *trials_used = NULL, EstimateStats *stats = NULL) const;
+
+        /* Anytime version of estimate(): rather than a fixed trial count it
+         * plays as many trials as fit in budget_ms milliseconds, up to
+         * max_trials per rollout pass. The seki pass gets the first half of
+         * the budget and pass1 whatever is left. The first
+         * ROLLOUT_FIRST_BATCH trials of each pass are always played, so
+         * very small budgets can be overrun. The trial counts reached are
+         * stored in seki_trials and pass1_trials if given, the per phase
+         * stats in stats. Results are not cached. */
+        Grid estimate_for(Color player_to_move, double budget_ms, float tolerance, int max_trials, int *seki_trials = NULL, int *pass1_trials = NULL, EstimateStats *stats = NULL) const;
+
+        /* Warm started estimate() for a position only a move or so away
+         * from one estimated before, such as the next position of a game.
+         * prior is what that estimate left behind, and is overwritten with
+         * what this one leaves.
+         *
+         * The points the difference could affect are the changed points,
+         * the strings on and next to them and the empty points up to
+         * INCREMENTAL_REACH steps from those. Rollouts stop as soon as these
+         * are settled, or after 1/INCREMENTAL_TRIAL_SHARE of the trials, and
+         * their counts come from the new trials alone. Everywhere else the
+         * new trials are pooled with the prior's, so settled areas keep
+         * their ownership and open ones firm up from one position to the
+         * next. If prior doesn't match (see EstimatePrior::matches), or the
+         * difference could affect more than half the board, this is a full
+         * estimate that fills it in for next time. Results depend on the
+         * positions estimated before, so they are not cached. budget_ms, if
+         * positive, limits the time as in estimate_for(). */
+        Grid estimate_incremental(Color player_to_move, int trials, float tolerance, EstimatePrior &prior, double budget_ms = 0, int *trials_used = NULL, EstimateStats *stats = NULL) const;
+
+        /* Estimates count boards of the same size in one go. boards holds
+         * them back to back, each row by row (or column by column if
+         * column_major is set), and out receives the ownership maps in the
+         * same layout. The positions are spread across
+         * num_threads workers (0 means one per available core), each
+         * estimating its positions single threaded. Position i is seeded
+         * from (seed, i), so the results don't depend on the worker count. */
+        static void estimate_batch(int width, int height, int count, const int *boards, const int *players_to_move, int trials, float tolerance, unsigned seed, int num_threads, bool adaptive, bool column_major, int *out);
         Point generateMove(Color player, int trials, float tolerance);
         inline int at(const Point &p) const { return board[p]; }
-        inline int& at(const Point &p) { return board[p]; }
+        inline signed char& at(const Point &p) { return board[p]; }
         inline int operator[](const Point &p) const { return board[p]; }
-        inline int& operator[](const Point &p) { return board[p]; }
+        inline signed char& operator[](const Point &p) { return board[p]; }
         void setSize(int width, int height);
         void clearBoard();
-        void play_out_position(Color player_to_move, const Grid &life_map, const Grid &seki);
+        void play_out_position(Color player_to_move, const GridMask &life_map, const GridMask &seki);
         Result place_and_remove(Point move, Color player, Vec &possible_moves);
 
         /* Looks for probable seki situations and returns them as a binary grid */
-        Grid scanForSeki(int num_iterations, float tolerance, const Grid &rollout_pass) const;
+        GridMask scanForSeki(int num_iterations, float tolerance, const Grid &rollout_pass) const;
 
         /** Returns a list of false eyes detected */
         Vec getFalseEyes() const;
@@ -60,8 +125,16 @@ class Goban {
          * invadable, which for our purposes is fine. Such things would be
          * horrible for a bot, but we're just trying to mark the board up how
          * the players, who may be weak or strong, view the board. 
+         *
+         * If stop_tolerance is non zero or there is a deadline, trials are
+         * played in growing batches. They stop early as soon as
+         * rollouts_settled() holds for stop_tolerance or the deadline
+         * passes.
+         * The counts are then scaled up to num_iterations so thresholds
+         * computed from num_iterations still apply. The number of trials
+         * actually played is stored in trials_used if given.
          */
-        Grid rollout(int num_iterations, Color player_to_move, bool pullup_life_based_on_neigboring_territory = true, const Grid &life_map = Grid(), const Grid &bias = Grid(), const Grid &seki = Grid()) const;
+        Grid rollout(int num_iterations, Color player_to_move, bool pullup_life_based_on_neigboring_territory = true, const GridMask &life_map = GridMask(), const Grid &bias = Grid(), const GridMask &seki = GridMask(), float stop_tolerance = 0, int *trials_used = NULL) const;
 
         /** 
          * We bias positions on the board based on who they currently belong
@@ -83,7 +156,7 @@ class Goban {
          * Marks each location with the positive or negative size of the
          * territory (negative for white, postive for black), or zero if the
          * location is not territory. */
-        Grid computeTerritory();
+        Grid computeTerritory() const;
 
         /** Uniquely labels strings of groups on the board. */
         Grid computeGroupMap() const;
@@ -110,7 +183,71 @@ class Goban {
         Vec getDead(int num_iterations, float tolerance, const Grid &rollout_pass) const;
 
     private:
-        Grid _estimate(Color player_to_move, int trials, float tolerance, bool debug);
+        /* Where _estimate records its per phase stats, if anywhere. Not owned. */
+        EstimateStats *stats;
+
+        /* Strings and empty regions of board, built by _estimate once the
+         * false eyes are filled and shared by the passes after that. Not
+         * owned, NULL outside of _estimate. */
+        const BoardAnalysis *analysis;
+
+        /* State of the previous estimate for estimate_incremental to start
+         * from and update, NULL otherwise. Not owned. */
+        EstimatePrior *prior;
+
+        /* Set once _estimate has found prior to match the position, focus
+         * then holds the points the difference could affect */
+        bool      warm;
+        GridMask  focus;
+
+        /* Index of the rollout pass _estimate is on, 0 for the seki pass */
+        int       current_pass;
+
+        /* Wall clock budget for _estimate in milliseconds, 0 for none, and
+         * the deadline of the rollout pass currently being played */
+        double    time_budget_ms;
+        bool      has_deadline;
+        std::chrono::steady_clock::time_point deadline;
+
+        /* Runs the estimate, storing the number of trials each of the two
+         * rollout passes played in pass_trials if given */
+        Grid _estimate(Color player_to_move, int trials, float tolerance, bool debug, int *pass_trials);
+        /* Works out focus from prior for the position given, which board is
+         * after its false eyes got filled, and returns its number of points */
+        int warm_start(const ColorGrid &given);
+        /* Pools the counts of rollout pass current_pass outside of focus
+         * with the prior's and records the result in prior */
+        void blend_prior(Grid &counts, int num_trials) const;
+        /* analysis if set, otherwise the workspace's scratch index built
+         * from board */
+        const BoardAnalysis& board_analysis() const;
+        inline bool past_deadline() const { return has_deadline && std::chrono::steady_clock::now() >= deadline; }
+        /* Plays the trials of rollout() into counts on a TPlayoutBoard<SIZE>,
+         * SIZE being the board size or 0 for the generic board, and returns
+         * how many were played */
+        template<int SIZE>
+        int  rollout_trials(int num_iterations, Color player_to_move, const GridMask &life_map, const Grid &bias, const GridMask &seki, float stop_tolerance, Grid &counts) const;
+        /* Plays trials [first_trial, end_trial) across the worker threads and
+         * adds the filled in boards into counts, returning the number of
+         * trials played. That is fewer than asked for if the estimate got
+         * cancelled or ran past its deadline. first_trial must be a
+         * multiple of ROLLOUT_CHUNK_SIZE. */
+        template<int SIZE>
+        int  play_rollouts(int first_trial, int end_trial, Color player_to_move, const GridMask &life_map, const GridMask &seki, const TPlayoutBoard<SIZE> &initial, Grid &counts) const;
+        /* Plays every num_workers'th chunk of trials starting at chunk
+         * first_chunk + worker, accumulating the filled in boards into out
+         * and the number of trials, moves, captures and so on into played.
+         * playout is the worker's scratch board, reset to initial before
+         * every trial. */
+        template<int SIZE>
+        void rollout_worker(int worker, int num_workers, int first_chunk, int end_trial, Color player_to_move, const GridMask &life_map, const GridMask &seki, const TPlayoutBoard<SIZE> &initial, TPlayoutBoard<SIZE> &playout, Grid &out, PhaseStats &played) const;
+        /* True if, after num_trials trials, every point's mean ownership
+         * (plus its share of bias) is confidently clear of the +-tolerance
+         * thresholds and, for stones, of the +-tolerance/3 dame threshold.
+         * Points sitting so close to a threshold that a num_iterations run
+         * couldn't place them reliably either don't hold things up. */
+        bool rollouts_settled(const Grid &counts, int num_trials, int num_iterations, float tolerance, const Grid &bias) const;
+        int  rollout_thread_count(int num_chunks) const;
         bool has_liberties(const Point &pt);
         int  remove_group(Point move, Vec &possible_moves);
         bool is_eye(Point move, Color player) const;
@@ -3,9 +3,45 @@
 #include "constants.h"
 #include "Point.h"
 #include "Vec.h"
+#include "GridKernels.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+
+/* Generation stamped visited marks shared by the TGrid flood fills of a
+ * thread. Each flood takes a fresh generation from next() and a point counts
+ * as visited once its mark equals that, so the marks never need clearing and
+ * a flood only costs as much as the points it reaches. Floods don't nest, so
+ * one set per thread is enough, and the same goes for the work list. */
+class FloodMarks {
+    public:
+        int     marks[MAX_HEIGHT][MAX_WIDTH];
+        int     generation;
+        Vec     queue;
+
+        /* Starts a flood: returns a fresh generation and empties queue */
+        inline int next() {
+            if (generation == INT_MAX) {
+                memset(marks, 0, sizeof(marks));
+                generation = 0;
+            }
+            queue.size = 0;
+            return ++generation;
+        }
+
+        /* Marks p for generation gen, returning false if it already was */
+        inline bool visit(const Point &p, int gen) {
+            if (marks[p.y][p.x] == gen) {
+                return false;
+            }
+            marks[p.y][p.x] = gen;
+            return true;
+        }
+};
+
+/* Defined in Goban.cpp */
+extern THREAD_LOCAL FloodMarks flood_marks;
 
 /* Simple 2d array used for various purposes while tracking game and estimation state */
 
@@ -17,11 +53,24 @@ class TGrid {
 
         TGrid(int width=-1, int height=-1) 
             : width(width <= 0 ? default_grid_width : width)
-            , height(height < 0 ? default_grid_height : height) 
+            , height(height <= 0 ? default_grid_height : height) 
         {
             clear();
         }
 
+        /* Copies a grid with another element type, converting each point */
+        template<typename U>
+        explicit TGrid(const TGrid<U, MAX_W, MAX_H> &o)
+            : width(o.width)
+            , height(o.height)
+        {
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    _data[y][x] = (T)o[y][x];
+                }
+            }
+        }
+
         inline T* operator[](const int &y) { return _data[y]; }
         inline const T* operator[](const int &y) const { return _data[y]; }
         inline T at(const Point &p) const { return _data[p.y][p.x]; }
@@ -29,36 +78,20 @@ class TGrid {
         inline T operator[](const Point &p) const { return _data[p.y][p.x]; }
         inline T& operator[](const Point &p) { return _data[p.y][p.x]; }
         inline TGrid operator+(const TGrid &o) const { 
-            TGrid ret(width, height);
-            for (int y=0; y < height; ++y) {
-                for (int x=0; x < width; ++x) {
-                    ret[y][x] = _data[y][x] + o._data[y][x];
-                }
-            }
+            TGrid ret(*this);
+            ret += o;
             return ret;
         }
         inline TGrid& operator+=(const TGrid &o) { 
-            for (int y=0; y < height; ++y) {
-                for (int x=0; x < width; ++x) {
-                     _data[y][x] += o._data[y][x];
-                }
-            }
+            grid_rows_add(_data[0], o._data[0], width, height, MAX_W);
             return *this;
         }
         inline TGrid& operator*=(const TGrid &o) { 
-            for (int y=0; y < height; ++y) {
-                for (int x=0; x < width; ++x) {
-                     _data[y][x] *= o._data[y][x];
-                }
-            }
+            grid_rows_mul(_data[0], o._data[0], width, height, MAX_W);
             return *this;
         }
         inline TGrid& operator*=(const T &v) { 
-            for (int y=0; y < height; ++y) {
-                for (int x=0; x < width; ++x) {
-                     _data[y][x] *= v;
-                }
-            }
+            grid_rows_scale(_data[0], v, width, height, MAX_W);
             return *this;
         }
         inline TGrid operator*(const TGrid &o) const { 
@@ -74,23 +107,20 @@ class TGrid {
 
         /* Clears all locations with the provided value */ 
         void clear(const T &value=0) {
-            for (int y=0; y < height; ++y) {
-                for (int x=0; x < width; ++x) {
-                    _data[y][x] = value;
-                }
-            }
+            grid_rows_fill(_data[0], value, width, height, MAX_W);
         }
 
         /* Flood matches all similar values starting at the starting_point, writes value to
          * the corresponding coordinates int he destination grid. */
         void traceGroup(const Point &starting_point, TGrid &destination, const T &value) const {
-            Vec         tocheck;
+            Vec        &tocheck = flood_marks.queue;
             Vec         neighbors;
-            TGrid<int>  visited(width, height);
+            int         gen = flood_marks.next();
             T           matching_value = (*this)[starting_point];
 
+            ++flood_fill_count;
             tocheck.push(starting_point);
-            visited[starting_point] = 1;
+            flood_marks.visit(starting_point, gen);
 
             while (tocheck.size) {
                 Point p = tocheck.remove(0);
@@ -99,11 +129,9 @@ class TGrid {
                     getNeighbors(p, neighbors);
                     for (int i=0; i < neighbors.size; ++i) {
                         Point neighbor = neighbors[i];
-                        if (visited[neighbor]) {
-                            continue;
+                        if (flood_marks.visit(neighbor, gen)) {
+                            tocheck.push(neighbor);
                         }
-                        visited[neighbor] = 1;
-                        tocheck.push(neighbor);
                     }
                 }
             }
@@ -117,14 +145,15 @@ class TGrid {
             groupAndNeighbors(starting_points, group, out_neighbors);
         }
         void groupAndNeighbors(const Vec &starting_points, Vec &group, Vec &out_neighbors) const {
-            Vec         tocheck;
+            Vec        &tocheck = flood_marks.queue;
             Vec         neighbors;
-            TGrid<int>  visited(width, height);
+            int         gen = flood_marks.next();
             T           matching_value = (*this)[starting_points[0]];
 
+            ++flood_fill_count;
             for (int i=0; i < starting_points.size; ++i) {
                 tocheck.push(starting_points[i]);
-                visited[starting_points[i]] = 1;
+                flood_marks.visit(starting_points[i], gen);
             }
 
             while (tocheck.size) {
@@ -134,11 +163,9 @@ class TGrid {
                     getNeighbors(p, neighbors);
                     for (int i=0; i < neighbors.size; ++i) {
                         const Point &neighbor = neighbors[i];
-                        if (visited[neighbor]) {
-                            continue;
+                        if (flood_marks.visit(neighbor, gen)) {
+                            tocheck.push(neighbor);
                         }
-                        visited[neighbor] = 1;
-                        tocheck.push(neighbor);
                     }
                 } else {
                     out_neighbors.push(p);
@@ -150,15 +177,16 @@ class TGrid {
          * treated as one big group) touching the starting points is less than
          * the given amount. */
         bool hasLessLibertiesThan(const Vec &starting_points, int amount) const {
-            Vec         tocheck;
+            Vec        &tocheck = flood_marks.queue;
             Vec         neighbors;
-            TGrid<int>  visited(width, height);
+            int         gen = flood_marks.next();
             T           matching_value = (*this)[starting_points[0]];
             int         total_liberties = 0;
 
+            ++flood_fill_count;
             for (int i=0; i < starting_points.size; ++i) {
                 tocheck.push(starting_points[i]);
-                visited[starting_points[i]] = 1;
+                flood_marks.visit(starting_points[i], gen);
             }
 
             while (tocheck.size) {
@@ -166,10 +194,9 @@ class TGrid {
                 getNeighbors(p, neighbors);
                 for (int i=0; i < neighbors.size; ++i) {
                     const Point &neighbor = neighbors[i];
-                    if (visited[neighbor]) {
+                    if (!flood_marks.visit(neighbor, gen)) {
                         continue;
                     }
-                    visited[neighbor] = 1;
 
                     int v = (*this)[neighbor];
                     if (v == matching_value) {
@@ -189,14 +216,15 @@ class TGrid {
         /* Flood matches all similar values starting at starting_point, writing all points
          * within the flood match to group. */
         Vec group(const Point &starting_point) const {
-            Vec         tocheck;
+            Vec        &tocheck = flood_marks.queue;
             Vec         ret;
             Vec         neighbors;
-            TGrid<int>  visited(width, height);
+            int         gen = flood_marks.next();
             T           matching_value = (*this)[starting_point];
 
+            ++flood_fill_count;
             tocheck.push(starting_point);
-            visited[starting_point] = 1;
+            flood_marks.visit(starting_point, gen);
 
             while (tocheck.size) {
                 Point p = tocheck.remove(0);
@@ -205,11 +233,9 @@ class TGrid {
                     getNeighbors(p, neighbors);
                     for (int i=0; i < neighbors.size; ++i) {
                         Point neighbor = neighbors[i];
-                        if (visited[neighbor]) {
-                            continue;
+                        if (flood_marks.visit(neighbor, gen)) {
+                            tocheck.push(neighbor);
                         }
-                        visited[neighbor] = 1;
-                        tocheck.push(neighbor);
                     }
                 }
             }
@@ -416,13 +442,7 @@ class TGrid {
 
         /* Sums up all points */
         T sum() const {
-            T total = 0;
-            for (int y=0; y < height; ++y) {
-                for (int x=0; x < width; ++x) {
-                    total += _data[y][x];
-                }
-            }
-            return total;
+            return grid_rows_sum(_data[0], width, height, MAX_W);
         }
 
         /* Sums up all points in a group */
@@ -536,4 +556,88 @@ class TGrid {
 #endif
 };
 
-typedef TGrid<int> Grid;
\ No newline at end of file
+typedef TGrid<int> Grid;
+
+/* Stones only, EMPTY, BLACK or WHITE per point */
+typedef TGrid<signed char> ColorGrid;
+
+/* Binary map of the board, one bit per point. Rows are at most MAX_WIDTH
+ * (25) points wide, so each fits a 32 bit word. */
+class GridMask {
+    public:
+        int width;
+        int height;
+
+        GridMask(int width=-1, int height=-1)
+            : width(width <= 0 ? default_grid_width : width)
+            , height(height <= 0 ? default_grid_height : height)
+        {
+            clear();
+        }
+
+        /* Sets every point of grid that is not 0 */
+        template<typename T>
+        explicit GridMask(const TGrid<T> &grid)
+            : width(grid.width)
+            , height(grid.height)
+        {
+            clear();
+            for (int y=0; y < height; ++y) {
+                uint32_t row = 0;
+                for (int x=0; x < width; ++x) {
+                    row |= (uint32_t)(grid[y][x] != 0) << x;
+                }
+                _rows[y] = row;
+            }
+        }
+
+        inline bool get(int x, int y) const { return (_rows[y] >> x) & 1; }
+        inline bool operator[](const Point &p) const { return get(p.x, p.y); }
+        inline uint32_t row(int y) const { return _rows[y]; }
+
+        inline void set(const Point &p) { _rows[p.y] |= (uint32_t)1 << p.x; }
+
+        bool any() const {
+            for (int y=0; y < height; ++y) {
+                if (_rows[y]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /* Sets all points in group */
+        void set(const Vec &group) {
+            for (int i=0; i < group.size; ++i) {
+                set(group[i]);
+            }
+        }
+
+        void clear() {
+            for (int y=0; y < MAX_HEIGHT; ++y) {
+                _rows[y] = 0;
+            }
+        }
+
+        inline GridMask operator|(const GridMask &o) const {
+            GridMask ret(*this);
+            for (int y=0; y < height; ++y) {
+                ret._rows[y] |= o._rows[y];
+            }
+            return ret;
+        }
+
+        /* 1 for every set point, 0 elsewhere */
+        Grid grid() const {
+            Grid ret(width, height);
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    ret[y][x] = get(x, y);
+                }
+            }
+            return ret;
+        }
+
+    private:
+        uint32_t    _rows[MAX_HEIGHT];
+};
@@ -0,0 +1,399 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#  if defined(__SSE2__)
+#    include <immintrin.h>
+#    define GRID_KERNELS_SSE2 1
+#    if defined(__GNUC__) || defined(__clang__)
+#      define GRID_KERNELS_AVX2 1
+#    endif
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define GRID_KERNELS_NEON 1
+#endif
+
+/* Kernels behind TGrid<int> arithmetic and playout scoring.
+ *
+ * Every function works on rows rows of n consecutive ints (the live cells
+ * of a grid), stride ints apart, so a whole grid costs one indirect call.
+ * Each comes in a plain C++ version plus vector versions: SSE2 and AVX2 on
+ * x86, NEON on ARM. grid_kernels() picks the widest one the CPU supports
+ * the first time it is called. SSE2 is part of both x86 Android ABIs and
+ * NEON of both ARM ones, so only AVX2 needs a runtime check. */
+class GridKernels {
+    public:
+        void        (*add)(int *dst, const int *src, int n, int rows, int stride);
+        void        (*mul)(int *dst, const int *src, int n, int rows, int stride);
+        void        (*scale)(int *dst, int v, int n, int rows, int stride);
+        void        (*fill)(int *dst, int v, int n, int rows, int stride);
+        int         (*sum)(const int *src, int n, int rows, int stride);
+        /* dst += src, widening int8 values, for adding in a playout's
+         * per point scores. src rows are src_stride bytes apart. */
+        void        (*add_int8)(int *dst, const signed char *src, int n, int rows, int stride, int src_stride);
+        const char  *name;
+};
+
+/* Rows shorter than this don't fill a vector, they get the plain loop
+ * inline instead of a call through GridKernels */
+#define GRID_KERNELS_MIN_ROW 8
+
+namespace grid_kernels_impl {
+
+    inline void add_scalar(int *dst, const int *src, int n) {
+        for (int i=0; i < n; ++i) {
+            dst[i] += src[i];
+        }
+    }
+    inline void mul_scalar(int *dst, const int *src, int n) {
+        for (int i=0; i < n; ++i) {
+            dst[i] *= src[i];
+        }
+    }
+    inline void scale_scalar(int *dst, int v, int n) {
+        for (int i=0; i < n; ++i) {
+            dst[i] *= v;
+        }
+    }
+    inline void fill_scalar(int *dst, int v, int n) {
+        for (int i=0; i < n; ++i) {
+            dst[i] = v;
+        }
+    }
+    inline int sum_scalar(const int *src, int n) {
+        int total = 0;
+        for (int i=0; i < n; ++i) {
+            total += src[i];
+        }
+        return total;
+    }
+    inline void add_int8_scalar(int *dst, const signed char *src, int n) {
+        for (int i=0; i < n; ++i) {
+            dst[i] += src[i];
+        }
+    }
+
+#ifdef GRID_KERNELS_SSE2
+    inline void add_sse2(int *dst, const int *src, int n) {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi32(d, s));
+        }
+        add_scalar(dst + i, src + i, n - i);
+    }
+    inline void fill_sse2(int *dst, int v, int n) {
+        __m128i vv = _mm_set1_epi32(v);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_si128((__m128i*)(dst + i), vv);
+        }
+        fill_scalar(dst + i, v, n - i);
+    }
+    inline int sum_sse2(const int *src, int n) {
+        __m128i acc = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)(src + i)));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(acc) + sum_scalar(src + i, n - i);
+    }
+    inline void add_int8_sse2(int *dst, const signed char *src, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            /* sign extend 8 bytes to 8 ints by unpacking into the high
+             * byte of each lane and shifting back down */
+            __m128i b  = _mm_loadl_epi64((const __m128i*)(src + i));
+            __m128i w  = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+            __m128i d0 = _mm_loadu_si128((const __m128i*)(dst + i));
+            __m128i d1 = _mm_loadu_si128((const __m128i*)(dst + i + 4));
+            _mm_storeu_si128((__m128i*)(dst + i),     _mm_add_epi32(d0, lo));
+            _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_add_epi32(d1, hi));
+        }
+        add_int8_scalar(dst + i, src + i, n - i);
+    }
+#endif
+
+#ifdef GRID_KERNELS_AVX2
+    __attribute__((target("avx2")))
+    inline void add_avx2(int *dst, const int *src, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi32(d, s));
+        }
+        add_scalar(dst + i, src + i, n - i);
+    }
+    __attribute__((target("avx2")))
+    inline void mul_avx2(int *dst, const int *src, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_mullo_epi32(d, s));
+        }
+        mul_scalar(dst + i, src + i, n - i);
+    }
+    __attribute__((target("avx2")))
+    inline void scale_avx2(int *dst, int v, int n) {
+        __m256i vv = _mm256_set1_epi32(v);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_mullo_epi32(d, vv));
+        }
+        scale_scalar(dst + i, v, n - i);
+    }
+    __attribute__((target("avx2")))
+    inline void fill_avx2(int *dst, int v, int n) {
+        __m256i vv = _mm256_set1_epi32(v);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + i), vv);
+        }
+        fill_scalar(dst + i, v, n - i);
+    }
+    __attribute__((target("avx2")))
+    inline int sum_avx2(const int *src, int n) {
+        __m256i acc = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i*)(src + i)));
+        }
+        __m128i a = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+        a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(a) + sum_scalar(src + i, n - i);
+    }
+    __attribute__((target("avx2")))
+    inline void add_int8_avx2(int *dst, const signed char *src, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi32(d, s));
+        }
+        add_int8_scalar(dst + i, src + i, n - i);
+    }
+
+    inline bool cpu_has_avx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+
+#ifdef GRID_KERNELS_NEON
+    inline void add_neon(int *dst, const int *src, int n) {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            vst1q_s32(dst + i, vaddq_s32(vld1q_s32(dst + i), vld1q_s32(src + i)));
+        }
+        add_scalar(dst + i, src + i, n - i);
+    }
+    inline void mul_neon(int *dst, const int *src, int n) {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            vst1q_s32(dst + i, vmulq_s32(vld1q_s32(dst + i), vld1q_s32(src + i)));
+        }
+        mul_scalar(dst + i, src + i, n - i);
+    }
+    inline void scale_neon(int *dst, int v, int n) {
+        int32x4_t vv = vdupq_n_s32(v);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            vst1q_s32(dst + i, vmulq_s32(vld1q_s32(dst + i), vv));
+        }
+        scale_scalar(dst + i, v, n - i);
+    }
+    inline void fill_neon(int *dst, int v, int n) {
+        int32x4_t vv = vdupq_n_s32(v);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            vst1q_s32(dst + i, vv);
+        }
+        fill_scalar(dst + i, v, n - i);
+    }
+    inline int sum_neon(const int *src, int n) {
+        int32x4_t acc = vdupq_n_s32(0);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc = vaddq_s32(acc, vld1q_s32(src + i));
+        }
+        int32x2_t half = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+        return vget_lane_s32(vpadd_s32(half, half), 0) + sum_scalar(src + i, n - i);
+    }
+    inline void add_int8_neon(int *dst, const signed char *src, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t w = vmovl_s8(vld1_s8((const int8_t*)(src + i)));
+            vst1q_s32(dst + i,     vaddw_s16(vld1q_s32(dst + i),     vget_low_s16(w)));
+            vst1q_s32(dst + i + 4, vaddw_s16(vld1q_s32(dst + i + 4), vget_high_s16(w)));
+        }
+        add_int8_scalar(dst + i, src + i, n - i);
+    }
+#endif
+
+    /* Whole grid versions of the row kernels above. The row kernel is a
+     * template argument, so it is called directly for every row. */
+    template<void (*ROW)(int*, const int*, int)>
+    inline void rows_of(int *dst, const int *src, int n, int rows, int stride) {
+        for (int y=0; y < rows; ++y) {
+            ROW(dst + y * stride, src + y * stride, n);
+        }
+    }
+    template<void (*ROW)(int*, int, int)>
+    inline void rows_of(int *dst, int v, int n, int rows, int stride) {
+        for (int y=0; y < rows; ++y) {
+            ROW(dst + y * stride, v, n);
+        }
+    }
+    template<int (*ROW)(const int*, int)>
+    inline int rows_of(const int *src, int n, int rows, int stride) {
+        int total = 0;
+        for (int y=0; y < rows; ++y) {
+            total += ROW(src + y * stride, n);
+        }
+        return total;
+    }
+    template<void (*ROW)(int*, const signed char*, int)>
+    inline void rows_of(int *dst, const signed char *src, int n, int rows, int stride, int src_stride) {
+        for (int y=0; y < rows; ++y) {
+            ROW(dst + y * stride, src + y * src_stride, n);
+        }
+    }
+
+    inline GridKernels select() {
+        GridKernels k;
+        k.add      = rows_of<add_scalar>;
+        k.mul      = rows_of<mul_scalar>;
+        k.scale    = rows_of<scale_scalar>;
+        k.fill     = rows_of<fill_scalar>;
+        k.sum      = rows_of<sum_scalar>;
+        k.add_int8 = rows_of<add_int8_scalar>;
+        k.name     = "scalar";
+
+#if defined(GRID_KERNELS_SSE2)
+        /* SSE2 has no 32 bit multiply, the compiler's own loops do as well */
+        k.add      = rows_of<add_sse2>;
+        k.fill     = rows_of<fill_sse2>;
+        k.sum      = rows_of<sum_sse2>;
+        k.add_int8 = rows_of<add_int8_sse2>;
+        k.name     = "sse2";
+#endif
+#if defined(GRID_KERNELS_AVX2)
+        if (cpu_has_avx2()) {
+            k.add      = rows_of<add_avx2>;
+            k.mul      = rows_of<mul_avx2>;
+            k.scale    = rows_of<scale_avx2>;
+            k.fill     = rows_of<fill_avx2>;
+            k.sum      = rows_of<sum_avx2>;
+            k.add_int8 = rows_of<add_int8_avx2>;
+            k.name     = "avx2";
+        }
+#endif
+#if defined(GRID_KERNELS_NEON)
+        k.add      = rows_of<add_neon>;
+        k.mul      = rows_of<mul_neon>;
+        k.scale    = rows_of<scale_neon>;
+        k.fill     = rows_of<fill_neon>;
+        k.sum      = rows_of<sum_neon>;
+        k.add_int8 = rows_of<add_int8_neon>;
+        k.name     = "neon";
+#endif
+        return k;
+    }
+}
+
+/* The kernels for this CPU, picked on first use */
+inline const GridKernels& grid_kernels() {
+    static const GridKernels kernels = grid_kernels_impl::select();
+    return kernels;
+}
+
+/* Grid helpers TGrid uses: ints go through grid_kernels() unless their
+ * rows are short, every other element type gets the plain loop */
+template<typename T> inline void grid_rows_add(T *dst, const T *src, int n, int rows, int stride) {
+    for (int y=0; y < rows; ++y, dst += stride, src += stride) {
+        for (int i=0; i < n; ++i) {
+            dst[i] += src[i];
+        }
+    }
+}
+template<typename T> inline void grid_rows_mul(T *dst, const T *src, int n, int rows, int stride) {
+    for (int y=0; y < rows; ++y, dst += stride, src += stride) {
+        for (int i=0; i < n; ++i) {
+            dst[i] *= src[i];
+        }
+    }
+}
+template<typename T> inline void grid_rows_scale(T *dst, const T &v, int n, int rows, int stride) {
+    for (int y=0; y < rows; ++y, dst += stride) {
+        for (int i=0; i < n; ++i) {
+            dst[i] *= v;
+        }
+    }
+}
+template<typename T> inline void grid_rows_fill(T *dst, const T &v, int n, int rows, int stride) {
+    for (int y=0; y < rows; ++y, dst += stride) {
+        for (int i=0; i < n; ++i) {
+            dst[i] = v;
+        }
+    }
+}
+template<typename T> inline T grid_rows_sum(const T *src, int n, int rows, int stride) {
+    T total = 0;
+    for (int y=0; y < rows; ++y, src += stride) {
+        for (int i=0; i < n; ++i) {
+            total += src[i];
+        }
+    }
+    return total;
+}
+
+inline void grid_rows_add(int *dst, const int *src, int n, int rows, int stride) {
+    if (n < GRID_KERNELS_MIN_ROW) {
+        grid_rows_add<int>(dst, src, n, rows, stride);
+    } else {
+        grid_kernels().add(dst, src, n, rows, stride);
+    }
+}
+inline void grid_rows_mul(int *dst, const int *src, int n, int rows, int stride) {
+    if (n < GRID_KERNELS_MIN_ROW) {
+        grid_rows_mul<int>(dst, src, n, rows, stride);
+    } else {
+        grid_kernels().mul(dst, src, n, rows, stride);
+    }
+}
+inline void grid_rows_scale(int *dst, const int &v, int n, int rows, int stride) {
+    if (n < GRID_KERNELS_MIN_ROW) {
+        grid_rows_scale<int>(dst, v, n, rows, stride);
+    } else {
+        grid_kernels().scale(dst, v, n, rows, stride);
+    }
+}
+inline void grid_rows_fill(int *dst, const int &v, int n, int rows, int stride) {
+    if (n < GRID_KERNELS_MIN_ROW) {
+        grid_rows_fill<int>(dst, v, n, rows, stride);
+    } else {
+        grid_kernels().fill(dst, v, n, rows, stride);
+    }
+}
+inline int grid_rows_sum(const int *src, int n, int rows, int stride) {
+    if (n < GRID_KERNELS_MIN_ROW) {
+        return grid_rows_sum<int>(src, n, rows, stride);
+    }
+    return grid_kernels().sum(src, n, rows, stride);
+}
+inline void grid_rows_add_int8(int *dst, const signed char *src, int n, int rows, int stride, int src_stride) {
+    if (n < GRID_KERNELS_MIN_ROW) {
+        grid_kernels_impl::rows_of<grid_kernels_impl::add_int8_scalar>(dst, src, n, rows, stride, src_stride);
+    } else {
+        grid_kernels().add_int8(dst, src, n, rows, stride, src_stride);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "constants.h"
+#include "Color.h"
+#include "Point.h"
+#include <stdint.h>
+
+/* Packed 3x3 neighborhood codes and the shape tables they index.
+ *
+ * Every point's surroundings are stored as two bytes of four 2 bit cells:
+ * the orthogonal code holds the neighbors at -1, +1, -stride, +stride and
+ * the corner code the diagonal points at -stride-1, -stride+1, +stride-1,
+ * +stride+1, in that order. A cell is the color masked to two bits, so
+ * EMPTY 0, BLACK 1, OFFBOARD 2 and WHITE 3.
+ *
+ * The shape half of the eye, false eye and horseshoe tests is then one
+ * lookup in a 256 entry table holding a bit per player (bit 0 for black,
+ * bit 1 for white), see pattern_side. Only the rare cases where a corner
+ * looks dangerous still need to ask about liberties. */
+
+enum {
+    PATTERN_EMPTY    = 0,
+    PATTERN_BLACK    = 1,
+    PATTERN_OFFBOARD = 2,
+    PATTERN_WHITE    = 3,
+};
+
+/* Cell value of a color, EMPTY, BLACK, WHITE or the playout boards' OFFBOARD (2) */
+constexpr int pattern_cell(int color) { return color & 3; }
+
+/* Table bit for player */
+constexpr int pattern_side(int player) { return player == BLACK ? 1 : 2; }
+
+constexpr int pattern_slot(int code, int slot) { return (code >> (slot * 2)) & 3; }
+
+constexpr int pattern_count(int code, int cell) {
+    return (pattern_slot(code, 0) == cell) + (pattern_slot(code, 1) == cell)
+         + (pattern_slot(code, 2) == cell) + (pattern_slot(code, 3) == cell);
+}
+
+/* Every orthogonal neighbor is the player's or off the board */
+constexpr uint8_t pattern_eye_entry(int code) {
+    return (pattern_count(code, PATTERN_BLACK) + pattern_count(code, PATTERN_OFFBOARD) == 4 ? 1 : 0)
+         | (pattern_count(code, PATTERN_WHITE) + pattern_count(code, PATTERN_OFFBOARD) == 4 ? 2 : 0);
+}
+
+/* No enemy neighbor and at most one empty one */
+constexpr uint8_t pattern_horseshoe_entry(int code) {
+    return (pattern_count(code, PATTERN_WHITE) == 0 && pattern_count(code, PATTERN_EMPTY) <= 1 ? 1 : 0)
+         | (pattern_count(code, PATTERN_BLACK) == 0 && pattern_count(code, PATTERN_EMPTY) <= 1 ? 2 : 0);
+}
+
+/* The enemy holds at least half of the on-board corners, rounded down,
+ * which is when an eye may be false */
+constexpr uint8_t pattern_corner_risk_entry(int code) {
+    return (pattern_count(code, PATTERN_WHITE) >= ((4 - pattern_count(code, PATTERN_OFFBOARD)) >> 1) ? 1 : 0)
+         | (pattern_count(code, PATTERN_BLACK) >= ((4 - pattern_count(code, PATTERN_OFFBOARD)) >> 1) ? 2 : 0);
+}
+
+#define PATTERN_TABLE_4(f, i)   f(i), f(i + 1), f(i + 2), f(i + 3)
+#define PATTERN_TABLE_16(f, i)  PATTERN_TABLE_4(f, i), PATTERN_TABLE_4(f, i + 4), PATTERN_TABLE_4(f, i + 8), PATTERN_TABLE_4(f, i + 12)
+#define PATTERN_TABLE_64(f, i)  PATTERN_TABLE_16(f, i), PATTERN_TABLE_16(f, i + 16), PATTERN_TABLE_16(f, i + 32), PATTERN_TABLE_16(f, i + 48)
+#define PATTERN_TABLE_256(f)    PATTERN_TABLE_64(f, 0), PATTERN_TABLE_64(f, 64), PATTERN_TABLE_64(f, 128), PATTERN_TABLE_64(f, 192)
+
+/* Indexed by orthogonal code */
+static constexpr uint8_t pattern_eye_shape[256]       = { PATTERN_TABLE_256(pattern_eye_entry) };
+static constexpr uint8_t pattern_horseshoe_shape[256] = { PATTERN_TABLE_256(pattern_horseshoe_entry) };
+/* Indexed by corner code */
+static constexpr uint8_t pattern_corner_risk[256]     = { PATTERN_TABLE_256(pattern_corner_risk_entry) };
+
+#undef PATTERN_TABLE_256
+#undef PATTERN_TABLE_64
+#undef PATTERN_TABLE_16
+#undef PATTERN_TABLE_4
+
+/* Builds both codes of pt straight from a board, for callers that don't
+ * keep them up to date. Points off the edge read as OFFBOARD. */
+template<typename G>
+inline void pattern_codes(const G &board, const Point &pt, int &orthogonal, int &corner) {
+    const int dx[8] = { -1, 1,  0, 0, -1,  1, -1, 1 };
+    const int dy[8] = {  0, 0, -1, 1, -1, -1,  1, 1 };
+    int codes[2] = { 0, 0 };
+
+    for (int i=0; i < 8; ++i) {
+        int x = pt.x + dx[i];
+        int y = pt.y + dy[i];
+        int cell = x < 0 || y < 0 || x >= board.width || y >= board.height
+            ? PATTERN_OFFBOARD
+            : pattern_cell(board[y][x]);
+        codes[i >> 2] |= cell << ((i & 3) * 2);
+    }
+
+    orthogonal = codes[0];
+    corner = codes[1];
+}
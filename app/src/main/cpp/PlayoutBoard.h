@@ -0,0 +1,648 @@
+#pragma once
+
+#include "constants.h"
+#include "Color.h"
+#include "Point.h"
+#include "Grid.h"
+#include "EstimateStats.h"
+#include "Random.h"
+#include "Pattern3x3.h"
+#include <string.h>
+
+/* Board used for random playouts.
+ *
+ * The board is a flat array of (width+2) x (height+2) cells: the playing area
+ * plus a one cell ring of OFFBOARD sentinels around it. Points are addressed
+ * by a 16 bit index into that array, and the four neighbors of any on-board
+ * point are always at the fixed offsets -1, +1, -stride and +stride, so none
+ * of the neighbor loops need any bounds checks.
+ *
+ * Besides the stones it keeps track of strings as linked rings (next[] walks
+ * every stone of a string, head[] points at the string's representative
+ * stone) and of the pseudo liberties of each string, that is the number of
+ * (stone, empty neighbor) pairs along with the sum and sum of squares of the
+ * empty points' indices. Those are updated as stones are placed and
+ * captured, which makes "does this string have liberties" and "is this string
+ * in atari" O(1) questions:
+ *
+ *   no liberties: plibs == 0
+ *   in atari:     plibs * lib_sum_sq == lib_sum * lib_sum
+ *                 (every pseudo liberty is the same point)
+ *
+ * SIZE > 0 fixes the board at SIZE x SIZE at compile time: the stride, the
+ * neighbor offsets and all the loop bounds become constants and the arrays
+ * shrink to fit. PlayoutBoard, SIZE 0, takes any size at run time.
+ */
+
+/* Dimensions of a TPlayoutBoard, constants for a fixed size */
+template<int SIZE>
+class PlayoutGeometry {
+    public:
+        static constexpr int width = SIZE;
+        static constexpr int height = SIZE;
+        static constexpr int stride = SIZE + 2;
+        static constexpr int offsets[4] = { -1, 1, -(SIZE + 2), SIZE + 2 };
+
+        PlayoutGeometry(int, int) {}
+};
+template<int SIZE> constexpr int PlayoutGeometry<SIZE>::width;
+template<int SIZE> constexpr int PlayoutGeometry<SIZE>::height;
+template<int SIZE> constexpr int PlayoutGeometry<SIZE>::stride;
+template<int SIZE> constexpr int PlayoutGeometry<SIZE>::offsets[4];
+
+template<>
+class PlayoutGeometry<0> {
+    public:
+        int         width;
+        int         height;
+        int         stride;
+        int         offsets[4];
+
+        PlayoutGeometry(int width, int height)
+            : width(width)
+            , height(height)
+            , stride(width + 2)
+        {
+            offsets[0] = -1;
+            offsets[1] = 1;
+            offsets[2] = -stride;
+            offsets[3] = stride;
+        }
+};
+
+template<int SIZE>
+class TPlayoutBoard : public PlayoutGeometry<SIZE> {
+    public:
+        enum Result {
+            OK = 0,
+            ILLEGAL = 1,
+        };
+
+        enum {
+            OFFBOARD = 2,
+            NO_CANDIDATE = 0xffff,
+        };
+
+        enum {
+            PADDED_SIZE = SIZE ? (SIZE + 2) * (SIZE + 2) : MAX_PADDED_SIZE,
+            VEC_SIZE = SIZE ? SIZE * SIZE : MAX_VEC_SIZE,
+        };
+
+        using PlayoutGeometry<SIZE>::width;
+        using PlayoutGeometry<SIZE>::height;
+        using PlayoutGeometry<SIZE>::stride;
+        using PlayoutGeometry<SIZE>::offsets;
+
+    public:
+        int         do_ko_check;
+        PointIndex  possible_ko;
+
+        int         color[PADDED_SIZE];
+        PointIndex  head[PADDED_SIZE];
+        PointIndex  next[PADDED_SIZE];
+
+        /* 3x3 neighborhood of every point, see Pattern3x3.h. Kept up to
+         * date by set_color as stones are placed and captured. */
+        uint8_t     nbr_code[PADDED_SIZE];
+        uint8_t     corner_code[PADDED_SIZE];
+
+        /* Indexed by the string's head */
+        int         num_stones[PADDED_SIZE];
+        int         plibs[PADDED_SIZE];
+        int         lib_sum[PADDED_SIZE];
+        long long   lib_sum_sq[PADDED_SIZE];
+
+        /* Generation stamped visited marks for flood fills. Neither is
+         * touched by load() or reset(), so the marks never need clearing. */
+        int         visited[PADDED_SIZE];
+        int         visited_counter;
+
+        /* Score of each point of the last playout scored, see accumulate_score */
+        signed char territory[PADDED_SIZE];
+
+        /* Per color (black, white) sets of points still worth trying during
+         * a playout, with O(1) insert and delete. candidate_pos[side][idx] is
+         * idx's slot in candidates[side], or NO_CANDIDATE. */
+        PointIndex  candidates[2][VEC_SIZE];
+        PointIndex  candidate_pos[2][PADDED_SIZE];
+        int         num_candidates[2];
+        char        playable[PADDED_SIZE];
+
+        /* Moves, captures, rejected moves and flood fills so far. Not touched
+         * by load() or reset(), whoever owns the board clears them. */
+        PhaseStats  counters;
+
+        TPlayoutBoard(int width, int height)
+            : PlayoutGeometry<SIZE>(width, height)
+            , do_ko_check(0)
+            , possible_ko(0)
+            , visited_counter(0)
+        {
+            num_candidates[0] = 0;
+            num_candidates[1] = 0;
+
+            for (int i=0; i < stride * (this->height + 2); ++i) {
+                color[i] = OFFBOARD;
+                nbr_code[i] = 0;
+                corner_code[i] = 0;
+                visited[i] = 0;
+                playable[i] = 0;
+                candidate_pos[0][i] = NO_CANDIDATE;
+                candidate_pos[1][i] = NO_CANDIDATE;
+            }
+        }
+
+        inline PointIndex index(int x, int y) const { return (PointIndex)((y + 1) * stride + x + 1); }
+        inline Point point(PointIndex idx) const { return Point(idx % stride - 1, idx / stride - 1); }
+        inline bool isStone(int c) const { return c == BLACK || c == WHITE; }
+
+        inline bool has_liberties(PointIndex idx) const { return plibs[head[idx]] > 0; }
+        inline bool in_atari(PointIndex idx) const {
+            PointIndex h = head[idx];
+            return plibs[h] > 0 && (long long)plibs[h] * lib_sum_sq[h] == (long long)lib_sum[h] * lib_sum[h];
+        }
+
+        /* Loads the stones from a regular board and builds the string state */
+        void load(const ColorGrid &board) {
+            do_ko_check = 0;
+            possible_ko = 0;
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    color[index(x, y)] = EMPTY;
+                }
+            }
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    build_codes(index(x, y));
+                }
+            }
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    if (board[y][x]) {
+                        add_stone(index(x, y), (Color)board[y][x]);
+                    }
+                }
+            }
+        }
+
+        /* Resets this board to the state of other, which must be the same
+         * size. Only the rows holding live points are copied. */
+        void reset(const TPlayoutBoard &other) {
+            int first = stride;
+            int count = stride * height;
+
+            memcpy(color + first,       other.color + first,       count * sizeof(color[0]));
+            memcpy(head + first,        other.head + first,        count * sizeof(head[0]));
+            memcpy(next + first,        other.next + first,        count * sizeof(next[0]));
+            memcpy(nbr_code + first,    other.nbr_code + first,    count * sizeof(nbr_code[0]));
+            memcpy(corner_code + first, other.corner_code + first, count * sizeof(corner_code[0]));
+            memcpy(num_stones + first,  other.num_stones + first,  count * sizeof(num_stones[0]));
+            memcpy(plibs + first,       other.plibs + first,       count * sizeof(plibs[0]));
+            memcpy(lib_sum + first,     other.lib_sum + first,     count * sizeof(lib_sum[0]));
+            memcpy(lib_sum_sq + first,  other.lib_sum_sq + first,  count * sizeof(lib_sum_sq[0]));
+
+            do_ko_check = other.do_ko_check;
+            possible_ko = other.possible_ko;
+        }
+
+        /* Scores the finished playout into out: +1 for every black stone
+         * and every point of an empty region bordered by black stones only,
+         * -1 likewise for white.
+         *
+         * Done in a single raster scan. The first point of an empty region
+         * the scan comes to is the region's lowest index, so one flood from
+         * there can label every point of the region with its owner before
+         * the scan reaches them, and each region is flooded exactly once.
+         * Once the board is labelled it is added to out with the widening
+         * int8 kernel. */
+        void accumulate_score(Grid &out) {
+            PointIndex  region[VEC_SIZE];
+            int         stamp = ++visited_counter;
+
+            for (int y=0; y < height; ++y) {
+                PointIndex first = index(0, y);
+                for (PointIndex idx = first; idx < first + width; ++idx) {
+                    int c = color[idx];
+                    if (c != EMPTY) {
+                        territory[idx] = (signed char)c;
+                        continue;
+                    }
+                    if (visited[idx] == stamp) {
+                        continue;
+                    }
+
+                    int num_region = 0;
+                    int borders = 0;
+
+                    ++counters.flood_fills;
+                    region[num_region++] = idx;
+                    visited[idx] = stamp;
+                    for (int i=0; i < num_region; ++i) {
+                        PointIndex p = region[i];
+                        for (int j=0; j < 4; ++j) {
+                            PointIndex n = p + offsets[j];
+                            int nc = color[n];
+                            if (nc == EMPTY) {
+                                if (visited[n] != stamp) {
+                                    visited[n] = stamp;
+                                    region[num_region++] = n;
+                                }
+                            } else {
+                                /* BLACK sets bit 0, WHITE bit 1, OFFBOARD neither */
+                                borders |= (nc == BLACK) | ((nc == WHITE) << 1);
+                            }
+                        }
+                    }
+
+                    signed char owner = borders == 1 ? BLACK : borders == 2 ? WHITE : EMPTY;
+                    for (int i=0; i < num_region; ++i) {
+                        territory[region[i]] = owner;
+                    }
+                }
+            }
+
+            /* the whole board is labelled now, add it in */
+            grid_rows_add_int8(out[0], territory + index(0, 0), width, height, MAX_WIDTH, stride);
+        }
+
+        /* Writes the stones back out to a regular board */
+        void store(ColorGrid &board) const {
+            for (int y=0; y < height; ++y) {
+                for (int x=0; x < width; ++x) {
+                    board[y][x] = color[index(x, y)];
+                }
+            }
+        }
+
+        /* Places a stone and removes any captured strings. Same rules as
+         * Goban::place_and_remove, but legality is decided up front from the
+         * string state so nothing ever needs to be undone.
+         *
+         * The move candidate sets are kept up to date along the way: the
+         * move leaves them, captured points join them, and every empty point
+         * whose eye or suicide status may have changed is offered again. */
+        Result place_and_remove(PointIndex move, Color player) {
+            if (do_ko_check) {
+                if (move == possible_ko) {
+                    return ILLEGAL;
+                }
+            }
+
+            bool legal = false;
+            for (int i=0; i < 4 && !legal; ++i) {
+                PointIndex n = move + offsets[i];
+                int c = color[n];
+                if (c == EMPTY) {
+                    legal = true;
+                } else if (c == player) {
+                    /* connecting to a string that has liberties besides this one */
+                    legal = has_liberties(n) && !in_atari(n);
+                } else if (c == -player) {
+                    /* capturing */
+                    legal = !has_liberties(n) || in_atari(n);
+                }
+            }
+            if (!legal) {
+                return ILLEGAL;
+            }
+
+            /* Whether the neighboring strings were down to one liberty before
+             * the move, strings that cross that line change the status of
+             * every one of their liberties. */
+            bool friend_short[4];
+            int  num_friends = 0;
+            for (int i=0; i < 4; ++i) {
+                PointIndex n = move + offsets[i];
+                if (color[n] == player) {
+                    friend_short[num_friends++] = in_atari(n);
+                }
+            }
+            bool enemy_short[4];
+            for (int i=0; i < 4; ++i) {
+                PointIndex n = move + offsets[i];
+                enemy_short[i] = color[n] == -player && in_atari(n);
+            }
+
+            add_stone(move, player);
+            remove_candidate(0, move);
+            remove_candidate(1, move);
+
+            int n_removed = 0;
+            PointIndex captured_at = 0;
+            for (int i=0; i < 4; ++i) {
+                PointIndex n = move + offsets[i];
+                if (color[n] == -player && plibs[head[n]] == 0) {
+                    captured_at = n;
+                    n_removed += remove_string(n);
+                }
+            }
+            counters.captures += n_removed;
+
+            if (n_removed == 1) {
+                do_ko_check = 1;
+                possible_ko = captured_at;
+            } else {
+                do_ko_check = 0;
+            }
+
+            invalidate_around(move);
+
+            bool now_short = !has_liberties(move) || in_atari(move);
+            for (int i=0; i < num_friends; ++i) {
+                if (friend_short[i] != now_short) {
+                    invalidate_liberties(move);
+                    break;
+                }
+            }
+            for (int i=0; i < 4; ++i) {
+                PointIndex n = move + offsets[i];
+                if (color[n] == -player && !enemy_short[i] && in_atari(n)) {
+                    invalidate_liberties(n);
+                }
+            }
+
+            return OK;
+        }
+
+        /* Mirrors Goban::is_eye, including the false eye check. The shape
+         * comes from the neighborhood codes, only an eye with enough enemy
+         * corners to be false needs its neighbors' liberties looked at. */
+        bool is_eye(PointIndex idx, Color player) const {
+            int side = pattern_side(player);
+            if (!(pattern_eye_shape[nbr_code[idx]] & side)) {
+                return false;
+            }
+
+            if (pattern_corner_risk[corner_code[idx]] & side) {
+                for (int i=0; i < 4; ++i) {
+                    PointIndex n = idx + offsets[i];
+                    if (color[n] == player && (!has_liberties(n) || in_atari(n))) {
+                        /* False eye */
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        /* Plays random moves until neither player has anywhere left to play
+         * without filling in their own eyes. Points marked in life_map or seki
+         * are left alone unless they get freed up by a capture.
+         *
+         * Each color draws from its own set of candidate points. A point that
+         * turns out to be an eye or illegal for that color is dropped from
+         * its set in O(1) and only offered again once a nearby move or
+         * capture could have changed that, so a player with no candidates
+         * left simply passes, and two passes in a row end the playout. */
+        void play_out_position(Color player_to_move, const GridMask &life_map, const GridMask &seki, PlayoutRandom &rand) {
+            do_ko_check = 0;
+            possible_ko = 0;
+
+            num_candidates[0] = 0;
+            num_candidates[1] = 0;
+            for (int y=0; y < height; ++y) {
+                uint32_t reserved = seki.row(y) | life_map.row(y);
+                for (int x=0; x < width; ++x) {
+                    PointIndex idx = index(x, y);
+                    playable[idx] = color[idx] == EMPTY && !((reserved >> x) & 1);
+                    candidate_pos[0][idx] = NO_CANDIDATE;
+                    candidate_pos[1][idx] = NO_CANDIDATE;
+                    if (playable[idx]) {
+                        add_candidate(0, idx);
+                        add_candidate(1, idx);
+                    }
+                }
+            }
+
+            /* A ko point is set aside until the next move or pass */
+            PointIndex parked = 0;
+
+            /* Real playouts end by passing long before this, it only guards
+             * against the rare long ko fight. */
+            int max_moves = 4 * width * height;
+            bool passed = false;
+
+            while (max_moves > 0) {
+                int side = (1 - player_to_move) >> 1;
+                bool played = false;
+
+                while (num_candidates[side] > 0) {
+                    PointIndex mv = candidates[side][rand.below(num_candidates[side])];
+
+                    if (do_ko_check && mv == possible_ko) {
+                        remove_candidate(side, mv);
+                        parked = mv;
+                        continue;
+                    }
+
+                    if (is_eye(mv, player_to_move) || place_and_remove(mv, player_to_move) != OK) {
+                        remove_candidate(side, mv);
+                        ++counters.illegal_moves;
+                        continue;
+                    }
+
+                    ++counters.moves;
+                    played = true;
+                    break;
+                }
+
+                if (parked) {
+                    invalidate(parked);
+                    parked = 0;
+                }
+
+                if (played) {
+                    passed = false;
+                    --max_moves;
+                } else {
+                    if (passed) {
+                        break;
+                    }
+                    passed = true;
+                    do_ko_check = 0;
+                }
+                player_to_move = (Color)-player_to_move;
+            }
+        }
+
+    private:
+        /* Changes the color of idx and patches the codes of the eight
+         * points around it. idx sits in orthogonal slot i^1 of the neighbor
+         * at offsets[i], and in corner slot 3-j of the one at corner j. */
+        inline void set_color(PointIndex idx, int c) {
+            int diff = pattern_cell(color[idx]) ^ pattern_cell(c);
+            color[idx] = c;
+
+            nbr_code[idx - 1]             ^= diff << 2;
+            nbr_code[idx + 1]             ^= diff;
+            nbr_code[idx - stride]        ^= diff << 6;
+            nbr_code[idx + stride]        ^= diff << 4;
+            corner_code[idx - stride - 1] ^= diff << 6;
+            corner_code[idx - stride + 1] ^= diff << 4;
+            corner_code[idx + stride - 1] ^= diff << 2;
+            corner_code[idx + stride + 1] ^= diff;
+        }
+
+        /* Builds the codes of idx from scratch */
+        void build_codes(PointIndex idx) {
+            const int corner_offsets[4] = { -stride - 1, -stride + 1, stride - 1, stride + 1 };
+            int nbr = 0;
+            int corner = 0;
+            for (int i=0; i < 4; ++i) {
+                nbr    |= pattern_cell(color[idx + offsets[i]]) << (i * 2);
+                corner |= pattern_cell(color[idx + corner_offsets[i]]) << (i * 2);
+            }
+            nbr_code[idx] = (uint8_t)nbr;
+            corner_code[idx] = (uint8_t)corner;
+        }
+
+        inline void add_liberty(PointIndex h, PointIndex lib) {
+            plibs[h]      += 1;
+            lib_sum[h]    += lib;
+            lib_sum_sq[h] += (long long)lib * lib;
+        }
+        inline void remove_liberty(PointIndex h, PointIndex lib) {
+            plibs[h]      -= 1;
+            lib_sum[h]    -= lib;
+            lib_sum_sq[h] -= (long long)lib * lib;
+        }
+
+        /* Puts a stone on the board, merging it with any friendly neighbors.
+         * Does not handle captures. */
+        void add_stone(PointIndex idx, Color player) {
+            set_color(idx, player);
+            head[idx]       = idx;
+            next[idx]       = idx;
+            num_stones[idx] = 1;
+            plibs[idx]      = 0;
+            lib_sum[idx]    = 0;
+            lib_sum_sq[idx] = 0;
+
+            for (int i=0; i < 4; ++i) {
+                PointIndex n = idx + offsets[i];
+                if (color[n] == EMPTY) {
+                    add_liberty(idx, n);
+                } else if (isStone(color[n])) {
+                    remove_liberty(head[n], idx);
+                }
+            }
+
+            for (int i=0; i < 4; ++i) {
+                PointIndex n = idx + offsets[i];
+                if (color[n] == player && head[n] != head[idx]) {
+                    merge_strings(head[n], head[idx]);
+                }
+            }
+        }
+
+        /* Merges the smaller of the two strings into the larger one */
+        void merge_strings(PointIndex a, PointIndex b) {
+            if (num_stones[a] < num_stones[b]) {
+                PointIndex t = a; a = b; b = t;
+            }
+
+            PointIndex s = b;
+            do {
+                head[s] = a;
+                s = next[s];
+            } while (s != b);
+
+            PointIndex t = next[a];
+            next[a] = next[b];
+            next[b] = t;
+
+            num_stones[a] += num_stones[b];
+            plibs[a]      += plibs[b];
+            lib_sum[a]    += lib_sum[b];
+            lib_sum_sq[a] += lib_sum_sq[b];
+        }
+
+        /* Removes the string containing idx, returning the number of stones
+         * removed. The freed points become candidates for both colors. */
+        int remove_string(PointIndex idx) {
+            PointIndex h = head[idx];
+            int n_removed = 0;
+
+            PointIndex s = h;
+            do {
+                set_color(s, EMPTY);
+                playable[s] = 1;
+                ++n_removed;
+                s = next[s];
+            } while (s != h);
+
+            /* the freed points are now liberties of whatever was next to them */
+            s = h;
+            do {
+                for (int i=0; i < 4; ++i) {
+                    PointIndex n = s + offsets[i];
+                    if (isStone(color[n])) {
+                        add_liberty(head[n], s);
+                    }
+                }
+                s = next[s];
+            } while (s != h);
+
+            /* Neighboring strings may have just come out of atari, and the
+             * eye shapes around the freed points have changed */
+            int stamp = ++visited_counter;
+            s = h;
+            do {
+                invalidate_around(s);
+                for (int i=0; i < 4; ++i) {
+                    PointIndex n = s + offsets[i];
+                    if (isStone(color[n]) && visited[head[n]] != stamp) {
+                        visited[head[n]] = stamp;
+                        invalidate_liberties(n);
+                    }
+                }
+                s = next[s];
+            } while (s != h);
+
+            return n_removed;
+        }
+
+        inline void add_candidate(int side, PointIndex idx) {
+            if (candidate_pos[side][idx] == NO_CANDIDATE) {
+                candidate_pos[side][idx] = (PointIndex)num_candidates[side];
+                candidates[side][num_candidates[side]++] = idx;
+            }
+        }
+        inline void remove_candidate(int side, PointIndex idx) {
+            PointIndex pos = candidate_pos[side][idx];
+            if (pos != NO_CANDIDATE) {
+                PointIndex last = candidates[side][--num_candidates[side]];
+                candidates[side][pos] = last;
+                candidate_pos[side][last] = pos;
+                candidate_pos[side][idx] = NO_CANDIDATE;
+            }
+        }
+
+        /* Offers an empty point to both colors again */
+        inline void invalidate(PointIndex idx) {
+            if (color[idx] == EMPTY && playable[idx]) {
+                add_candidate(0, idx);
+                add_candidate(1, idx);
+            }
+        }
+        void invalidate_around(PointIndex idx) {
+            for (int dy=-stride; dy <= stride; dy += stride) {
+                for (int dx=-1; dx <= 1; ++dx) {
+                    invalidate(idx + dy + dx);
+                }
+            }
+        }
+        void invalidate_liberties(PointIndex idx) {
+            PointIndex h = head[idx];
+            PointIndex s = h;
+            do {
+                for (int i=0; i < 4; ++i) {
+                    invalidate(s + offsets[i]);
+                }
+                s = next[s];
+            } while (s != h);
+        }
+};
+
+typedef TPlayoutBoard<0> PlayoutBoard;
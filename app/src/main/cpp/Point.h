@@ -1,15 +1,20 @@
 #pragma once
 
+#include <stdint.h>
+
+/* Index of a point in a flat, padded board (see PlayoutBoard) */
+typedef uint16_t PointIndex;
+
 class Point {
     public:
-        int x;
-        int y;
+        int16_t x;
+        int16_t y;
 
         Point(){
         }
 
         Point(int _x, int _y) 
-            : x(_x), y(_y) 
+            : x((int16_t)_x), y((int16_t)_y) 
         {
         }
 
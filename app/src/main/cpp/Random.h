@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Small counter based generator used by the playouts.
+ *
+ * Output n of stream (seed, stream) is the splitmix64 finalizer applied to
+ * a key derived from seed and stream plus n times the golden ratio. Setting
+ * up any stream is O(1) and the whole state is one word, so every rollout
+ * trial can cheaply draw from its own stream (seed, trial index) and the
+ * moves a trial plays never depend on which thread played it. */
+class PlayoutRandom {
+    public:
+        PlayoutRandom(uint64_t seed = 0, uint64_t stream = 0) {
+            reseed(seed, stream);
+        }
+
+        inline void reseed(uint64_t seed, uint64_t stream) {
+            state = mix(mix(seed) + stream);
+        }
+
+        inline uint32_t operator()() {
+            state += 0x9e3779b97f4a7c15ULL;
+            return (uint32_t)(mix(state) >> 32);
+        }
+
+        /* Uniform in [0, n) for n > 0. Multiply-shift, rejecting the few
+         * low words that would otherwise make it slightly biased (Lemire,
+         * "Fast Random Integer Generation in an Interval"). */
+        inline uint32_t below(uint32_t n) {
+            uint64_t m = (uint64_t)(*this)() * n;
+            uint32_t low = (uint32_t)m;
+            if (low < n) {
+                uint32_t threshold = (0u - n) % n;
+                while (low < threshold) {
+                    m = (uint64_t)(*this)() * n;
+                    low = (uint32_t)m;
+                }
+            }
+            return (uint32_t)(m >> 32);
+        }
+
+        /* splitmix64 finalizer */
+        static inline uint64_t mix(uint64_t z) {
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+    private:
+        uint64_t    state;
+};
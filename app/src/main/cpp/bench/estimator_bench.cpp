@@ -0,0 +1,364 @@
+/* Benchmarks Goban::estimate over the positions in corpus.txt.
+ *
+ * Every position is estimated --repeat times with the cache off; the median
+ * wall time is reported along with the rollout throughput, the number of
+ * heap allocations made by one estimate and the EstimateStats of the last
+ * run. Output is one JSON object per line:
+ * a "config" record, a "position" record per corpus entry, a "phase" record
+ * per game phase (opening, middle, endgame) and a final "total", so runs can
+ * be diffed or fed to a script to track regressions.
+ *
+ * With --adaptive the position records also give how many points the
+ * adaptive estimate shares with a fixed length one of the same seed, next
+ * to how many two fixed length estimates with different seeds share.
+ *
+ * With --incremental N every position is also reached as the last of N
+ * moves: N of its stones are taken off and put back one at a time, the
+ * first position estimated from scratch and each later one warm started
+ * from the one before (Goban::estimate_incremental). An "incremental"
+ * record per position gives the time and trials per warm step next to
+ * those of the cold estimate of the position at the same trial count, and
+ * how many points the final warm estimate and the cold one share with a
+ * reference estimate of four times the trials and another seed.
+ *
+ * Build and run on the host with:
+ *   cmake -S app -B build && cmake --build build --target estimator_bench
+ *   ./build/estimator_bench [--trials N] [--threads N] [--repeat N] [--seed N]
+ *                           [--adaptive] [--incremental N]
+ *                           [corpus.txt]
+ */
+#include "Goban.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ESTIMATOR_BENCH_CORPUS
+#  define ESTIMATOR_BENCH_CORPUS "corpus.txt"
+#endif
+
+static std::atomic<long long> alloc_count(0);
+static std::atomic<long long> alloc_bytes(0);
+
+void* operator new(size_t size) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add((long long)size, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+struct Position {
+    std::string  name;
+    std::string  phase;
+    int          size;
+    Color        to_move;
+    std::vector<std::string> rows;
+};
+
+struct Totals {
+    int          positions;
+    double       ms;
+    long long    trials;
+    long long    allocs;
+    long long    bytes;
+
+    Totals() : positions(0), ms(0), trials(0), allocs(0), bytes(0) {}
+
+    void add(double _ms, int _trials, long long _allocs, long long _bytes) {
+        ++positions;
+        ms += _ms;
+        trials += _trials;
+        allocs += _allocs;
+        bytes += _bytes;
+    }
+};
+
+/* Reads the corpus: each position is a "name phase size B|W" header line
+ * followed by size rows of '.', 'X' (black) and 'O' (white). Blank lines and
+ * lines starting with '#' are ignored. */
+static bool loadCorpus(const char *path, std::vector<Position> &out) {
+    std::ifstream f(path);
+    if (!f) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        Position p;
+        std::string to_move;
+        std::istringstream header(line);
+        if (!(header >> p.name >> p.phase >> p.size >> to_move)
+            || p.size < 2 || p.size > MAX_WIDTH) {
+            fprintf(stderr, "bad corpus header: %s\n", line.c_str());
+            return false;
+        }
+        p.to_move = to_move == "W" ? WHITE : BLACK;
+
+        while ((int)p.rows.size() < p.size && std::getline(f, line)) {
+            if ((int)line.size() < p.size) {
+                fprintf(stderr, "short row in %s\n", p.name.c_str());
+                return false;
+            }
+            p.rows.push_back(line);
+        }
+        if ((int)p.rows.size() < p.size) {
+            fprintf(stderr, "truncated position %s\n", p.name.c_str());
+            return false;
+        }
+        out.push_back(p);
+    }
+    return true;
+}
+
+static void setBoard(Goban &g, const Position &p, const std::vector<Point> &removed) {
+    for (int y=0; y < p.size; ++y) {
+        for (int x=0; x < p.size; ++x) {
+            char c = p.rows[y][x];
+            g.board[y][x] = c == 'X' ? BLACK : c == 'O' ? WHITE : EMPTY;
+        }
+    }
+    for (size_t i=0; i < removed.size(); ++i) {
+        g.board[removed[i]] = EMPTY;
+    }
+}
+
+static int countEqual(const Grid &a, const Grid &b) {
+    int n = 0;
+    for (int y=0; y < a.height; ++y) {
+        for (int x=0; x < a.width; ++x) {
+            n += a[y][x] == b[y][x];
+        }
+    }
+    return n;
+}
+
+/* Steps up to p through steps positions with one stone less each, see
+ * --incremental. Taking stones off a legal position only adds liberties,
+ * so putting them back never captures anything. */
+static void benchIncremental(Goban &g, const Position &p, int steps, int trials, float tolerance, const Grid &cold, double cold_ms, int cold_trials) {
+    std::vector<Point> stones;
+    for (int y=0; y < p.size; ++y) {
+        for (int x=0; x < p.size; ++x) {
+            if (p.rows[y][x] == 'X' || p.rows[y][x] == 'O') {
+                stones.push_back(Point(x, y));
+            }
+        }
+    }
+    std::minstd_rand rng(g.seed);
+    std::shuffle(stones.begin(), stones.end(), rng);
+    stones.resize(MIN((int)stones.size(), steps));
+
+    /* What both get compared with, fixed length so it doesn't depend on
+     * the stop rule */
+    unsigned seed = g.seed;
+    bool adaptive = g.adaptive;
+    g.seed = seed + 1;
+    g.adaptive = false;
+    setBoard(g, p, std::vector<Point>());
+    Grid reference = g.estimate(p.to_move, 4 * trials, tolerance, false);
+    g.seed = seed;
+    g.adaptive = adaptive;
+
+    EstimatePrior prior(p.size, p.size);
+    std::vector<Point> removed(stones);
+    setBoard(g, p, removed);
+    int first_trials = 0;
+    auto start = std::chrono::steady_clock::now();
+    Grid est = g.estimate_incremental(p.to_move, trials, tolerance, prior, 0, &first_trials);
+    double first_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double step_ms = 0;
+    long long step_trials = 0;
+    int num_steps = (int)removed.size();
+    while (!removed.empty()) {
+        removed.pop_back();
+        setBoard(g, p, removed);
+        int used = 0;
+        start = std::chrono::steady_clock::now();
+        est = g.estimate_incremental(p.to_move, trials, tolerance, prior, 0, &used);
+        step_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        step_trials += used;
+    }
+
+    int points = p.size * p.size;
+    printf("{\"type\":\"incremental\",\"name\":\"%s\",\"steps\":%d,\"first_ms\":%.3f,\"first_trials\":%d,\"step_ms\":%.3f,\"step_trials\":%.0f,\"cold_ms\":%.3f,\"cold_trials\":%d,\"agreement\":%.3f,\"cold_agreement\":%.3f}\n",
+           p.name.c_str(), num_steps, first_ms, first_trials,
+           num_steps ? step_ms / num_steps : 0.0, num_steps ? (double)step_trials / num_steps : 0.0,
+           cold_ms, cold_trials,
+           (double)countEqual(est, reference) / points, (double)countEqual(cold, reference) / points);
+}
+
+static void printTotals(const char *type, const char *phase, const Totals &t) {
+    printf("{\"type\":\"%s\"", type);
+    if (phase) {
+        printf(",\"phase\":\"%s\"", phase);
+    }
+    printf(",\"positions\":%d,\"ms\":%.3f,\"trials\":%lld,\"playouts_per_sec\":%.0f,\"allocs\":%lld,\"alloc_bytes\":%lld}\n",
+           t.positions, t.ms, t.trials, t.ms > 0 ? t.trials * 1000.0 / t.ms : 0.0, t.allocs, t.bytes);
+}
+
+int main(int argc, char **argv) {
+    const char *corpus = ESTIMATOR_BENCH_CORPUS;
+    int trials = 1000;
+    int threads = 1;
+    int repeat = 3;
+    unsigned seed = 42;
+    bool adaptive = false;
+    float tolerance = 0.3f;
+    int incremental = 0;
+
+    for (int i=1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--trials") && i + 1 < argc) {
+            trials = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--adaptive")) {
+            adaptive = true;
+        } else if (!strcmp(argv[i], "--incremental") && i + 1 < argc) {
+            incremental = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            corpus = argv[i];
+        } else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    repeat = MAX(1, repeat);
+
+    std::vector<Position> positions;
+    if (!loadCorpus(corpus, positions)) {
+        fprintf(stderr, "could not read corpus %s\n", corpus);
+        return 1;
+    }
+
+    printf("{\"type\":\"config\",\"corpus\":\"%s\",\"positions\":%d,\"trials\":%d,\"threads\":%d,\"repeat\":%d,\"seed\":%u,\"adaptive\":%s,\"tolerance\":%.2f,\"kernels\":\"%s\"}\n",
+           corpus, (int)positions.size(), trials, threads, repeat, seed,
+           adaptive ? "true" : "false", tolerance,
+           grid_kernels().name);
+
+    const char *phases[] = { "opening", "middle", "endgame" };
+    Totals phase_totals[3];
+    Totals total;
+
+    for (size_t i=0; i < positions.size(); ++i) {
+        const Position &p = positions[i];
+
+        Goban g(p.size, p.size);
+        setBoard(g, p, std::vector<Point>());
+        g.num_threads = threads;
+        g.seed = seed;
+        g.adaptive = adaptive;
+        g.use_cache = false;
+
+        std::vector<double> times;
+        int used = 0;
+        long long allocs = 0;
+        long long bytes = 0;
+        EstimateStats stats;
+        Grid result;
+        for (int r=0; r < repeat; ++r) {
+            long long allocs_before = alloc_count.load();
+            long long bytes_before = alloc_bytes.load();
+            auto start = std::chrono::steady_clock::now();
+            result = g.estimate(p.to_move, trials, tolerance, false, &used, &stats);
+            auto end = std::chrono::steady_clock::now();
+            allocs = alloc_count.load() - allocs_before;
+            bytes = alloc_bytes.load() - bytes_before;
+            times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        double ms = times[times.size() / 2];
+
+        int black = 0;
+        int white = 0;
+        for (int y=0; y < p.size; ++y) {
+            for (int x=0; x < p.size; ++x) {
+                black += result[y][x] > 0;
+                white += result[y][x] < 0;
+            }
+        }
+
+        /* Adaptive estimates play a prefix of the fixed length run, so
+         * compare against that, and against a fixed length run reseeded */
+        double agreement = 1;
+        double seed_agreement = 1;
+        if (adaptive) {
+            int points = p.size * p.size;
+            g.adaptive = false;
+            Grid fixed = g.estimate(p.to_move, trials, tolerance, false);
+            g.seed = seed + 1;
+            Grid reseeded = g.estimate(p.to_move, trials, tolerance, false);
+            g.seed = seed;
+            g.adaptive = true;
+            agreement = (double)countEqual(result, fixed) / points;
+            seed_agreement = (double)countEqual(reseeded, fixed) / points;
+        }
+
+        PhaseStats all = stats.total();
+        printf("{\"type\":\"position\",\"name\":\"%s\",\"phase\":\"%s\",\"size\":%d,\"ms\":%.3f,\"min_ms\":%.3f,\"trials\":%d,\"playouts_per_sec\":%.0f,\"allocs\":%lld,\"alloc_bytes\":%lld,\"black\":%d,\"white\":%d",
+               p.name.c_str(), p.phase.c_str(), p.size, ms, times[0], used,
+               ms > 0 ? used * 1000.0 / ms : 0.0, allocs, bytes, black, white);
+        printf(",\"moves\":%lld,\"captures\":%lld,\"illegal_moves\":%lld,\"flood_fills\":%lld,\"estimate_phase_ms\":{",
+               all.moves, all.captures, all.illegal_moves, all.flood_fills);
+        for (int k=0; k < EstimateStats::NUM_PHASES; ++k) {
+            printf("%s\"%s\":%.3f", k ? "," : "", EstimateStats::phase_name(k), stats.phases[k].nanoseconds / 1e6);
+        }
+        printf("}");
+        if (adaptive) {
+            printf(",\"agreement\":%.3f,\"seed_agreement\":%.3f", agreement, seed_agreement);
+        }
+        printf("}\n");
+
+        for (int k=0; k < 3; ++k) {
+            if (p.phase == phases[k]) {
+                phase_totals[k].add(ms, used, allocs, bytes);
+            }
+        }
+        total.add(ms, used, allocs, bytes);
+
+        if (incremental > 0) {
+            benchIncremental(g, p, incremental, trials, tolerance, result, ms, used);
+        }
+    }
+
+    for (int k=0; k < 3; ++k) {
+        printTotals("phase", phases[k], phase_totals[k]);
+    }
+    printTotals("total", NULL, total);
+    return 0;
+}
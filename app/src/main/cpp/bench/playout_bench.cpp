@@ -0,0 +1,57 @@
+/* Measures rollout throughput on empty, partly and mostly filled boards.
+ *
+ * A bitset based playout engine was once timed against the playout board
+ * here. It ran at 0.61-1.01x of its speed and was dropped, so only the
+ * playout board is measured now.
+ *
+ * Build and run on the host with:
+ *   cmake -S app -B build && cmake --build build --target playout_bench
+ *   ./build/playout_bench [trials]
+ */
+#include "Goban.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+
+/* Builds a position by playing num_moves random legal moves */
+static Goban makePosition(int size, int num_moves, unsigned seed) {
+    Goban g(size, size);
+    std::mt19937 rng(seed);
+    Color player = BLACK;
+    g.do_ko_check = 0;
+    g.possible_ko = Point(-1, -1);
+
+    for (int i=0, tries=0; i < num_moves && tries < num_moves * 10; ++tries) {
+        Point p(rng() % size, rng() % size);
+        Vec dummy;
+        if (g[p] == 0 && g.place_and_remove(p, player, dummy) == Goban::OK) {
+            player = other(player);
+            ++i;
+        }
+    }
+    return g;
+}
+
+static double playoutsPerSecond(Goban &g, int trials) {
+    auto start = std::chrono::steady_clock::now();
+    g.rollout(trials, BLACK, false);
+    auto end = std::chrono::steady_clock::now();
+    return trials / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+    int trials = argc > 1 ? atoi(argv[1]) : 2000;
+    const int sizes[] = { 9, 13, 19 };
+
+    printf("%-6s %-6s %14s\n", "size", "moves", "playouts/s");
+    for (int size : sizes) {
+        for (int moves : { 0, size * size / 3, size * size * 2 / 3 }) {
+            Goban g = makePosition(size, moves, 1234 + size + moves);
+            g.num_threads = 1;
+            g.seed = 42;
+
+            printf("%-6d %-6d %14.0f\n", size, moves, playoutsPerSecond(g, trials));
+        }
+    }
+    return 0;
+}
@@ -4,6 +4,40 @@
 #define MAX_HEIGHT 25
 #define MAX_VEC_SIZE (MAX_WIDTH*MAX_HEIGHT)
 
+/* Size of a flat board with a one point off-board border all the way around */
+#define MAX_PADDED_SIZE ((MAX_WIDTH+2)*(MAX_HEIGHT+2))
+
+/* Number of consecutive rollout trials handed to a worker thread at a time */
+#define ROLLOUT_CHUNK_SIZE 32
+
+/* Seed a Goban's rollouts start out with, so estimates are reproducible
+ * unless the caller picks a seed of their own */
+#define ROLLOUT_DEFAULT_SEED 0x5eed
+
+/* Adaptive rollouts check for convergence after this many trials, then
+ * after every doubling */
+#define ROLLOUT_FIRST_BATCH (2*ROLLOUT_CHUNK_SIZE)
+
+/* Width, in standard errors, of the per point intervals adaptive rollouts
+ * use to decide a point is settled, see Goban::rollouts_settled */
+#define ROLLOUT_STOP_Z 3.0
+
+/* Empty points up to this many steps from a changed point or a string next
+ * to one count as affected by the change in incremental estimates */
+#define INCREMENTAL_REACH 3
+
+/* Warm started rollout passes play at most 1/INCREMENTAL_TRIAL_SHARE of the
+ * trials, the points they redo are rarely all settled sooner */
+#define INCREMENTAL_TRIAL_SHARE 2
+
+/* Number of threads that keep their EstimateWorkspace from one estimate to
+ * the next once EstimateWorkspace::trim is in use, any beyond that free
+ * theirs after each estimate */
+#define ESTIMATE_WORKSPACES 4
+
+/* Number of finished estimates kept by EstimateCache */
+#define ESTIMATE_CACHE_SIZE 64
+
 #define MAX(a,b) ((a) < (b) ? (b) : (a))
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
@@ -13,8 +47,14 @@
 #  define THREAD_LOCAL
 #endif
 
-static THREAD_LOCAL int default_grid_width = -1000000;
-static THREAD_LOCAL int default_grid_height = -1000000;
+/* Size given to Grids constructed without one, set by Goban. Defined in
+ * Goban.cpp */
+extern THREAD_LOCAL int default_grid_width;
+extern THREAD_LOCAL int default_grid_height;
+
+/* Number of flood fills run by the calling thread, for EstimateStats.
+ * Defined in Goban.cpp */
+extern THREAD_LOCAL long long flood_fill_count;
 
 #ifdef DEBUG
 static const char board_letters[] = "abcdefghjklmnopqrstuvwxyz";
@@ -1,38 +1,267 @@
 //
 // Created by alex on 11/10/2018.
 //
-#define EMSCRIPTEN
-#define USE_THREADS 1
-
 #include <jni.h>
 #include "Goban.h"
-#include "Goban.cpp"
+#include "GameSession.h"
+#include <vector>
+
+/* Offset of (x, y) in a flat board, stored either row by row or column by column */
+static inline int cell_offset(int x, int y, int width, int height, bool column_major) {
+    return column_major ? x * height + y : y * width + x;
+}
 
+/* True if a width x height board fits the estimator */
+static inline bool valid_size(int width, int height) {
+    return width >= 1 && height >= 1 && width <= MAX_WIDTH && height <= MAX_HEIGHT;
+}
+
+/* Address of the direct ByteBuffer buffer, or NULL if it isn't one or holds
+ * fewer than size bytes */
+static int8_t *direct_buffer(JNIEnv *env, jobject buffer, jlong size) {
+    if (!buffer || env->GetDirectBufferCapacity(buffer) < size) {
+        return NULL;
+    }
+    return (int8_t*)env->GetDirectBufferAddress(buffer);
+}
+
+/* As direct_buffer, for one width x height board */
+static int8_t *board_buffer(JNIEnv *env, jobject buffer, int width, int height) {
+    return direct_buffer(env, buffer, (jlong)width * height);
+}
+
+/* Copies estimate_stats into the Java array out, if it is given and large
+ * enough: EstimateStats::NUM_PHASES groups of PhaseStats::NUM_COUNTERS
+ * counters, one group per phase */
+static void store_stats(JNIEnv *env, const EstimateStats &estimate_stats, jlongArray out) {
+    const int num_stats = EstimateStats::NUM_PHASES * PhaseStats::NUM_COUNTERS;
+    if (out && env->GetArrayLength(out) >= num_stats) {
+        long long values[num_stats];
+        estimate_stats.store(values);
+        jlong jvalues[num_stats];
+        for (int i=0; i < num_stats; ++i) {
+            jvalues[i] = (jlong)values[i];
+        }
+        env->SetLongArrayRegion(out, 0, num_stats, jvalues);
+    }
+}
+
+/* Estimates the board held in the direct ByteBuffer inBoard, one int8 cell
+ * per point, and writes the ownership map into outBoard in the same layout.
+ * Both buffers are owned by the caller and must hold width*height bytes,
+ * width and height go from 1 to 25; anything else returns 0 untouched.
+ * With a positive budgetMs the estimate plays as many trials as fit in that
+ * many milliseconds, up to trials per pass, instead of a fixed count.
+ * The same board, settings and seed always give the same estimate, unless
+ * the budget cuts it short. If stats is not null it receives EstimateStats::NUM_PHASES groups of
+ * PhaseStats::NUM_COUNTERS counters (nanoseconds, playouts, moves,
+ * captures, illegal moves, flood fills), one group per phase.
+ * Returns the total number of trials played. */
 extern "C"
-JNIEXPORT jintArray JNICALL
-Java_io_zenandroid_onlinego_gamelogic_RulesManager_estimate(JNIEnv *env, jobject instance, jint width,
-                                                            jint height, jintArray inBoard,
-                                                            jint player_to_move, jint trials,
-                                                            jfloat tolerance) {
-    jint *data = env->GetIntArrayElements(inBoard, NULL);
-    jint output[width*height];
+JNIEXPORT jint JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_estimateDirect(JNIEnv *env, jobject instance, jint width,
+                                                                  jint height, jobject inBoard, jobject outBoard,
+                                                                  jboolean columnMajor, jint player_to_move,
+                                                                  jint trials, jfloat tolerance, jint seed,
+                                                                  jint budgetMs, jlongArray stats) {
+    if (!valid_size(width, height)) {
+        return 0;
+    }
+    const int8_t *in = board_buffer(env, inBoard, width, height);
+    int8_t *out = board_buffer(env, outBoard, width, height);
+    if (!in || !out) {
+        return 0;
+    }
 
     Goban g(width, height);
-    for (int i=0, y=0; y < height; ++y) {
+    g.adaptive = true;
+    g.seed = (unsigned)seed;
+    for (int y=0; y < height; ++y) {
+        for (int x=0; x < width; ++x) {
+            g.board[y][x] = in[cell_offset(x, y, width, height, columnMajor)];
+        }
+    }
+
+    int trials_used = 0;
+    EstimateStats estimate_stats;
+    Grid est(width, height);
+    if (budgetMs > 0) {
+        int seki_trials = 0;
+        int pass1_trials = 0;
+        est = g.estimate_for((Color)player_to_move, budgetMs, tolerance, trials, &seki_trials, &pass1_trials, &estimate_stats);
+        trials_used = seki_trials + pass1_trials;
+    } else {
+        est = g.estimate((Color)player_to_move, trials, tolerance, false, &trials_used, &estimate_stats);
+    }
+
+    /* Estimates run on whichever JVM thread calls in, and there can be
+     * many of those, so only a few of them keep a workspace */
+    EstimateWorkspace::trim();
+    store_stats(env, estimate_stats, stats);
+
+    for (int y=0; y < height; ++y) {
+        for (int x=0; x < width; ++x) {
+            out[cell_offset(x, y, width, height, columnMajor)] = (int8_t)est[y][x];
+        }
+    }
+    return trials_used;
+}
+
+/* Estimates count boards of the same size in one call, spread across one
+ * worker per core. inBoards holds them back to back, laid out as for
+ * estimateDirect, and outBoards receives the ownership maps in the same
+ * layout; both must hold count*width*height bytes. playersToMove holds
+ * count bytes, the side to move in each position (1 for black, -1 for
+ * white). Position i is seeded from (seed, i), so the results don't depend
+ * on the number of cores. Returns the number of positions estimated, 0 if
+ * the size or any of the buffers is out of range, leaving outBoards
+ * untouched. */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_estimateBatch(JNIEnv *env, jobject instance, jint width,
+                                                                 jint height, jint count, jobject inBoards,
+                                                                 jobject playersToMove, jobject outBoards,
+                                                                 jboolean columnMajor, jint trials,
+                                                                 jfloat tolerance, jint seed) {
+    if (!valid_size(width, height) || count <= 0) {
+        return 0;
+    }
+    jlong size = (jlong)count * width * height;
+    const int8_t *in = direct_buffer(env, inBoards, size);
+    const int8_t *players = direct_buffer(env, playersToMove, count);
+    int8_t *out = direct_buffer(env, outBoards, size);
+    if (!in || !players || !out) {
+        return 0;
+    }
+
+    /* Goban::estimate_batch works on ints */
+    std::vector<int> boards(in, in + size);
+    std::vector<int> players_to_move(players, players + count);
+    std::vector<int> est(size);
+    Goban::estimate_batch(width, height, count, &boards[0], &players_to_move[0], trials, tolerance,
+                          (unsigned)seed, 0, true, columnMajor, &est[0]);
+    EstimateWorkspace::trim();
+
+    for (jlong i=0; i < size; ++i) {
+        out[i] = (int8_t)est[i];
+    }
+    return count;
+}
+
+/* Creates an empty width x height GameSession and returns its handle for the
+ * session* calls below, or 0 if the size is out of range. Moves are sent
+ * one at a time, so the board only crosses over in full when sessionLoad is
+ * called. */
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionCreate(JNIEnv *env, jobject instance, jint width,
+                                                                 jint height) {
+    if (!valid_size(width, height)) {
+        return 0;
+    }
+    return (jlong)(intptr_t)new GameSession(width, height);
+}
+
+/* Replaces the session's position with the board in inBoard (laid out as
+ * for estimateDirect), clearing its history */
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionLoad(JNIEnv *env, jobject instance, jlong handle,
+                                                               jobject inBoard, jboolean columnMajor) {
+    GameSession *s = (GameSession*)(intptr_t)handle;
+    if (!s) {
+        return;
+    }
+
+    int width = s->width();
+    int height = s->height();
+    const int8_t *in = board_buffer(env, inBoard, width, height);
+    if (!in) {
+        return;
+    }
+
+    ColorGrid board(width, height);
+    for (int y=0; y < height; ++y) {
         for (int x=0; x < width; ++x) {
-            g.board[y][x] = data[i++];
+            board[y][x] = in[cell_offset(x, y, width, height, columnMajor)];
         }
     }
+    s->load(board);
+}
+
+/* Plays player's stone (1 for black, -1 for white) at (x, y), returning the
+ * number of stones it captured or -1 if the move is illegal or player is
+ * neither, which leaves the session as it was */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionPlay(JNIEnv *env, jobject instance, jlong handle,
+                                                               jint x, jint y, jint player) {
+    GameSession *s = (GameSession*)(intptr_t)handle;
+    /* checked before building the Point, whose coordinates are 16 bit */
+    if (!s || x < 0 || y < 0 || x >= s->width() || y >= s->height()) {
+        return -1;
+    }
+    return s->play(Point(x, y), (Color)player);
+}
+
+/* Records a pass by player, ignored unless player is 1 or -1 */
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionPass(JNIEnv *env, jobject instance, jlong handle,
+                                                               jint player) {
+    GameSession *s = (GameSession*)(intptr_t)handle;
+    if (s) {
+        s->pass((Color)player);
+    }
+}
 
-    Grid est = g.estimate((Color)player_to_move, trials, tolerance, false);
-    for (int i=0 ,y=0; y < height; ++y) {
+/* Takes back the last move or pass, returns false if there was none */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionUndo(JNIEnv *env, jobject instance, jlong handle) {
+    GameSession *s = (GameSession*)(intptr_t)handle;
+    return s && s->undo() ? JNI_TRUE : JNI_FALSE;
+}
+
+/* As estimateDirect, for the session's current position and warm started
+ * from the session's previous estimate. Returns 0 without
+ * playing anything if the position was estimated last time with the same
+ * parameters, stats then holds that estimate's counters. */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionEstimate(JNIEnv *env, jobject instance, jlong handle,
+                                                                   jobject outBoard, jboolean columnMajor,
+                                                                   jint player_to_move, jint trials,
+                                                                   jfloat tolerance, jint seed, jint budgetMs,
+                                                                   jlongArray stats) {
+    GameSession *s = (GameSession*)(intptr_t)handle;
+    if (!s) {
+        return 0;
+    }
+
+    int width = s->width();
+    int height = s->height();
+    int8_t *out = board_buffer(env, outBoard, width, height);
+    if (!out) {
+        return 0;
+    }
+
+    int trials_used = 0;
+    EstimateStats estimate_stats;
+    Grid est = s->estimate((Color)player_to_move, trials, tolerance, (unsigned)seed, budgetMs, &trials_used, &estimate_stats);
+    EstimateWorkspace::trim();
+
+    store_stats(env, estimate_stats, stats);
+    for (int y=0; y < height; ++y) {
         for (int x=0; x < width; ++x) {
-            output[i++] = est[y][x];
+            out[cell_offset(x, y, width, height, columnMajor)] = (int8_t)est[y][x];
         }
     }
+    return trials_used;
+}
 
-    env->ReleaseIntArrayElements(inBoard, data, JNI_ABORT);
-    jintArray ret = env->NewIntArray(width*height);
-    env->SetIntArrayRegion (ret, 0, width*height, output);
-    return ret;
-}
\ No newline at end of file
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_zenandroid_onlinego_gamelogic_RulesManager_sessionRelease(JNIEnv *env, jobject instance, jlong handle) {
+    delete (GameSession*)(intptr_t)handle;
+}
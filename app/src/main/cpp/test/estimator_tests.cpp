@@ -0,0 +1,461 @@
+/* Host tests for the estimator core: the estimate cache, determinism across
+ * thread counts, batch and incremental estimates, the estimate workspace,
+ * playout board legality and agreement with Goban, and game sessions.
+ *
+ * Boards are written as rows of 'X' (black), 'O' (white) and '.' (empty).
+ * Every test runs regardless of earlier failures; the exit status is the
+ * number of failed checks.
+ *
+ * Build and run on the host with:
+ *   cmake -S app -B build && cmake --build build --target estimator_tests
+ *   ctest --test-dir build --output-on-failure
+ */
+#include "Goban.h"
+#include "GameSession.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        ++failures; \
+    } \
+} while (0)
+
+static ColorGrid makeBoard(const char *const *rows, int height) {
+    int width = (int)strlen(rows[0]);
+    ColorGrid board(width, height);
+    for (int y=0; y < height; ++y) {
+        for (int x=0; x < width; ++x) {
+            char c = rows[y][x];
+            board[y][x] = c == 'X' ? BLACK : c == 'O' ? WHITE : EMPTY;
+        }
+    }
+    return board;
+}
+
+static Goban makeGoban(const ColorGrid &board) {
+    Goban g(board.width, board.height);
+    g.board = board;
+    return g;
+}
+
+static bool sameBoard(const ColorGrid &a, const ColorGrid &b) {
+    if (a.width != b.width || a.height != b.height) {
+        return false;
+    }
+    for (int y=0; y < a.height; ++y) {
+        for (int x=0; x < a.width; ++x) {
+            if (a[y][x] != b[y][x]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool sameGrid(const Grid &a, const Grid &b) {
+    if (a.width != b.width || a.height != b.height) {
+        return false;
+    }
+    for (int y=0; y < a.height; ++y) {
+        for (int x=0; x < a.width; ++x) {
+            if (a[y][x] != b[y][x]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static const char *const rect_rows[] = {
+    "..XO...",
+    ".XXOO..",
+    ".XO.O..",
+    "..XO...",
+    ".......",
+};
+
+static const char *const nine_rows[] = {
+    "..XO.....",
+    ".XXOO..O.",
+    "..XXO.O..",
+    ".X.XOO...",
+    "..XXXO.O.",
+    ".X.X.XO..",
+    "..X..XOO.",
+    ".....XXO.",
+    ".........",
+};
+
+/* Every one of the 8 symmetries of a non-square board is a cache hit for
+ * the estimate of the original, mapped through the same symmetry */
+static void testCacheSymmetries() {
+    EstimateCache::instance().clear();
+    ColorGrid board = makeBoard(rect_rows, 5);
+    Goban g = makeGoban(board);
+    g.adaptive = true;
+
+    int used = 0;
+    Grid original = g.estimate(BLACK, 200, 0.3f, false, &used);
+    CHECK(used > 0);
+
+    for (int s=0; s < 8; ++s) {
+        int tw = s & 4 ? board.height : board.width;
+        int th = s & 4 ? board.width : board.height;
+        Goban t(tw, th);
+        t.adaptive = true;
+        for (int y=0; y < board.height; ++y) {
+            for (int x=0; x < board.width; ++x) {
+                int tx, ty;
+                EstimateCache::transform(s, board.width, board.height, x, y, tx, ty);
+                t.board[ty][tx] = board[y][x];
+            }
+        }
+
+        used = -1;
+        Grid est = t.estimate(BLACK, 200, 0.3f, false, &used);
+        CHECK(used == 0);
+        CHECK(est.width == tw && est.height == th);
+        for (int y=0; y < board.height; ++y) {
+            for (int x=0; x < board.width; ++x) {
+                int tx, ty;
+                EstimateCache::transform(s, board.width, board.height, x, y, tx, ty);
+                CHECK(est[ty][tx] == original[y][x]);
+            }
+        }
+    }
+
+    /* anything that changes the result is a miss */
+    Goban other = makeGoban(board);
+    other.adaptive = true;
+    other.estimate(WHITE, 200, 0.3f, false, &used);
+    CHECK(used > 0);
+    other.seed = 7;
+    other.estimate(BLACK, 200, 0.3f, false, &used);
+    CHECK(used > 0);
+    other.seed = ROLLOUT_DEFAULT_SEED;
+    other.adaptive = false;
+    other.estimate(BLACK, 200, 0.3f, false, &used);
+    CHECK(used > 0);
+    EstimateCache::instance().clear();
+}
+
+/* The estimate only depends on the seed and trial count, not on how many
+ * threads played the trials */
+static void testThreadCountDeterminism() {
+    for (int adaptive=0; adaptive < 2; ++adaptive) {
+        Goban g = makeGoban(makeBoard(nine_rows, 9));
+        g.use_cache = false;
+        g.adaptive = adaptive != 0;
+        g.num_threads = 1;
+
+        int expected_used = 0;
+        Grid expected = g.estimate(WHITE, 500, 0.3f, false, &expected_used);
+        for (int threads=2; threads <= 4; ++threads) {
+            g.num_threads = threads;
+            int used = 0;
+            Grid est = g.estimate(WHITE, 500, 0.3f, false, &used);
+            CHECK(used == expected_used);
+            CHECK(sameGrid(est, expected));
+        }
+    }
+}
+
+/* Batch results don't depend on the number of workers either, and match
+ * the layout they were given in */
+static void testBatchWorkerCounts() {
+    static const int count = 4;
+    ColorGrid board = makeBoard(nine_rows, 9);
+    int players[count] = { BLACK, WHITE, BLACK, WHITE };
+
+    std::vector<int> rows(count * 81);
+    std::vector<int> columns(count * 81);
+    for (int i=0; i < count; ++i) {
+        for (int y=0; y < 9; ++y) {
+            for (int x=0; x < 9; ++x) {
+                rows[i * 81 + y * 9 + x] = board[y][x];
+                columns[i * 81 + x * 9 + y] = board[y][x];
+            }
+        }
+    }
+
+    std::vector<int> expected(count * 81);
+    Goban::estimate_batch(9, 9, count, &rows[0], players, 300, 0.3f, 11, 1, true, false, &expected[0]);
+    for (int threads=2; threads <= count; ++threads) {
+        std::vector<int> out(count * 81);
+        Goban::estimate_batch(9, 9, count, &columns[0], players, 300, 0.3f, 11, threads, true, true, &out[0]);
+        for (int i=0; i < count; ++i) {
+            for (int y=0; y < 9; ++y) {
+                for (int x=0; x < 9; ++x) {
+                    CHECK(out[i * 81 + x * 9 + y] == expected[i * 81 + y * 9 + x]);
+                }
+            }
+        }
+    }
+}
+
+/* Freeing or trimming the thread's workspace between estimates, or
+ * switching board sizes in between, doesn't change them */
+static void testWorkspaceRelease() {
+    Goban g = makeGoban(makeBoard(nine_rows, 9));
+    g.use_cache = false;
+    g.adaptive = true;
+    Grid expected = g.estimate(BLACK, 300, 0.3f, false);
+
+    EstimateWorkspace::release();
+    CHECK(sameGrid(g.estimate(BLACK, 300, 0.3f, false), expected));
+
+    Goban rect = makeGoban(makeBoard(rect_rows, 5));
+    rect.use_cache = false;
+    rect.estimate(BLACK, 300, 0.3f, false);
+    CHECK(sameGrid(g.estimate(BLACK, 300, 0.3f, false), expected));
+
+    EstimateWorkspace::trim();
+    CHECK(sameGrid(g.estimate(BLACK, 300, 0.3f, false), expected));
+}
+
+/* A prior is only used for an estimate of the same size and parameters,
+ * and for a change that leaves most of the board alone */
+static void testIncrementalPrior() {
+    ColorGrid board = makeBoard(nine_rows, 9);
+    Goban g = makeGoban(board);
+    EstimatePrior prior(9, 9);
+    CHECK(!prior.matches(board, 200, 0.3f, ROLLOUT_DEFAULT_SEED));
+
+    int used = 0;
+    g.estimate_incremental(BLACK, 200, 0.3f, prior, 0, &used);
+    CHECK(used == 400);
+    CHECK(prior.matches(board, 200, 0.3f, ROLLOUT_DEFAULT_SEED));
+    CHECK(!prior.matches(board, 300, 0.3f, ROLLOUT_DEFAULT_SEED));
+    CHECK(!prior.matches(board, 200, 0.4f, ROLLOUT_DEFAULT_SEED));
+    CHECK(!prior.matches(board, 200, 0.3f, 7));
+    CHECK(!prior.matches(makeBoard(rect_rows, 5), 200, 0.3f, ROLLOUT_DEFAULT_SEED));
+
+    /* one more stone is warm started, with at most half the trials, and
+     * gives the same result on any number of threads */
+    g.board[8][8] = WHITE;
+    EstimatePrior copy = prior;
+    g.num_threads = 1;
+    Grid expected = g.estimate_incremental(BLACK, 200, 0.3f, prior, 0, &used);
+    CHECK(used > 0 && used <= 200);
+    g.num_threads = 3;
+    int threaded_used = 0;
+    CHECK(sameGrid(g.estimate_incremental(BLACK, 200, 0.3f, copy, 0, &threaded_used), expected));
+    CHECK(threaded_used == used);
+
+    /* a new seed, or a change all over the board, starts from scratch */
+    g.seed = 7;
+    g.estimate_incremental(BLACK, 200, 0.3f, prior, 0, &used);
+    CHECK(used == 400);
+    for (int y=0; y < 9; y += 2) {
+        for (int x=0; x < 9; x += 2) {
+            g.board[y][x] = g.board[y][x] ? EMPTY : BLACK;
+        }
+    }
+    g.estimate_incremental(BLACK, 200, 0.3f, prior, 0, &used);
+    CHECK(used == 400);
+    CHECK(prior.matches(g.board, 200, 0.3f, 7));
+}
+
+/* Suicide is illegal unless it captures, and a single stone capture can't
+ * be taken back straight away */
+static void testPlayoutLegality() {
+    static const char *const rows[] = {
+        ".X.....",
+        "X.XO...",
+        ".XO.O..",
+        "..XO...",
+        ".......",
+    };
+    TPlayoutBoard<0> playout(7, 5);
+    playout.load(makeBoard(rows, 5));
+
+    /* no liberties and nothing captured */
+    CHECK(playout.place_and_remove(playout.index(0, 0), WHITE) == TPlayoutBoard<0>::ILLEGAL);
+    CHECK(playout.place_and_remove(playout.index(1, 1), WHITE) == TPlayoutBoard<0>::ILLEGAL);
+    CHECK(playout.color[playout.index(1, 1)] == EMPTY);
+    /* filling its own eye is legal for black */
+    CHECK(playout.place_and_remove(playout.index(0, 0), BLACK) == TPlayoutBoard<0>::OK);
+
+    /* black takes the ko at (3, 2), capturing (2, 2) */
+    CHECK(playout.place_and_remove(playout.index(3, 2), BLACK) == TPlayoutBoard<0>::OK);
+    CHECK(playout.color[playout.index(2, 2)] == EMPTY);
+    CHECK(playout.place_and_remove(playout.index(2, 2), WHITE) == TPlayoutBoard<0>::ILLEGAL);
+    CHECK(playout.color[playout.index(3, 2)] == BLACK);
+
+    /* after a move elsewhere white can take back */
+    CHECK(playout.place_and_remove(playout.index(6, 4), WHITE) == TPlayoutBoard<0>::OK);
+    CHECK(playout.place_and_remove(playout.index(2, 2), WHITE) == TPlayoutBoard<0>::OK);
+    CHECK(playout.color[playout.index(3, 2)] == EMPTY);
+}
+
+/* Plays the same random moves on a playout board and a Goban and checks
+ * they agree on legality, captures, strings and atari after every move */
+template <int SIZE>
+static void playoutMatchesGoban(int width, int height, unsigned seed) {
+    TPlayoutBoard<SIZE> playout(width, height);
+    Goban goban(width, height);
+    goban.do_ko_check = 0;
+    goban.possible_ko = Point(-1, -1);
+    playout.load(goban.board);
+
+    PlayoutRandom rand(seed);
+    Color player = BLACK;
+    int mismatches = 0;
+    for (int move=0; move < 4 * width * height && mismatches == 0; ++move) {
+        Point p((int)rand.below(width), (int)rand.below(height));
+        if (goban.board[p] != EMPTY) {
+            continue;
+        }
+
+        Vec removed;
+        long long captures = playout.counters.captures;
+        Goban::Result expected = goban.place_and_remove(p, player, removed);
+        typename TPlayoutBoard<SIZE>::Result result = playout.place_and_remove(playout.index(p.x, p.y), player);
+        if ((expected == Goban::OK) != (result == TPlayoutBoard<SIZE>::OK)) {
+            ++mismatches;
+            break;
+        }
+        if (result != TPlayoutBoard<SIZE>::OK) {
+            continue;
+        }
+        mismatches += playout.counters.captures - captures != removed.size;
+        player = (Color)-player;
+
+        ColorGrid stored(width, height);
+        playout.store(stored);
+        mismatches += !sameBoard(stored, goban.board);
+
+        Grid groups = goban.computeGroupMap();
+        Grid liberties = goban.computeLiberties(groups);
+        for (int i=0; i < width * height; ++i) {
+            Point a(i % width, i / width);
+            if (goban.board[a] == EMPTY) {
+                continue;
+            }
+            int ai = playout.index(a.x, a.y);
+            int libs = liberties[a] < 0 ? -liberties[a] : liberties[a];
+            mismatches += playout.in_atari(ai) != (libs == 1);
+            mismatches += playout.has_liberties(ai) != (libs > 0);
+            for (int j=0; j < i; ++j) {
+                Point b(j % width, j / width);
+                if (goban.board[b] == EMPTY) {
+                    continue;
+                }
+                int bi = playout.index(b.x, b.y);
+                mismatches += (playout.head[ai] == playout.head[bi]) != (groups[a] == groups[b]);
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+static void testPlayoutMatchesGoban() {
+    for (unsigned seed=1; seed <= 8; ++seed) {
+        playoutMatchesGoban<0>(7, 5, seed);
+        playoutMatchesGoban<9>(9, 9, seed);
+        playoutMatchesGoban<0>(13, 13, seed);
+    }
+}
+
+/* Moves, passes and undos, with captures put back on undo */
+static void testSessionPlayUndo() {
+    GameSession session(7, 5);
+    ColorGrid start = makeBoard(rect_rows, 5);
+    session.load(start);
+
+    CHECK(session.play(Point(0, 0), EMPTY) == -1);
+    CHECK(!session.pass(EMPTY));
+    CHECK(session.play(Point(7, 0), BLACK) == -1);
+    CHECK(session.play(Point(2, 0), BLACK) == -1);
+    CHECK(session.moves() == 0);
+
+    /* white (2, 2) is down to its last liberty */
+    CHECK(session.play(Point(3, 2), BLACK) == 1);
+    CHECK(session.board()[2][2] == EMPTY);
+    CHECK(session.pass(WHITE));
+    CHECK(session.play(Point(6, 4), BLACK) == 0);
+    CHECK(session.moves() == 3);
+
+    CHECK(session.undo());
+    CHECK(session.undo());
+    CHECK(session.undo());
+    CHECK(!session.undo());
+    CHECK(sameBoard(session.board(), start));
+}
+
+/* A single stone capture by a lone stone left in atari can't be retaken
+ * straight away, anything else can */
+static void testSessionKo() {
+    static const char *const ko_rows[] = {
+        ".X.....",
+        "X.XO...",
+        ".XO.O..",
+        "..XO...",
+        ".......",
+    };
+    GameSession session(7, 5);
+    session.load(makeBoard(ko_rows, 5));
+
+    CHECK(session.play(Point(1, 1), WHITE) == -1);
+    CHECK(session.play(Point(3, 2), BLACK) == 1);
+    ColorGrid after_take = session.board();
+    CHECK(session.play(Point(2, 2), WHITE) == -1);
+    CHECK(sameBoard(session.board(), after_take));
+
+    /* a move elsewhere or a pass lifts the ko, undoing it puts it back */
+    CHECK(session.play(Point(6, 4), WHITE) == 0);
+    CHECK(session.play(Point(6, 0), BLACK) == 0);
+    CHECK(session.undo());
+    CHECK(session.undo());
+    CHECK(session.play(Point(2, 2), WHITE) == -1);
+    CHECK(session.pass(WHITE));
+    CHECK(session.play(Point(2, 2), WHITE) == 1);
+    CHECK(session.board()[2][3] == EMPTY);
+    CHECK(session.undo());
+    CHECK(session.undo());
+    CHECK(session.play(Point(2, 2), WHITE) == -1);
+
+    /* snapback: white takes the single black stone thrown in, and black
+     * takes back the whole white string on the same point */
+    static const char *const snapback_rows[] = {
+        "..X....",
+        "OOX....",
+        "XXX....",
+        ".......",
+        ".......",
+    };
+    session.load(makeBoard(snapback_rows, 5));
+    CHECK(session.play(Point(0, 0), BLACK) == 0);
+    CHECK(session.play(Point(1, 0), WHITE) == 1);
+    CHECK(session.play(Point(0, 0), BLACK) == 3);
+    CHECK(session.board()[1][0] == EMPTY && session.board()[1][1] == EMPTY);
+}
+
+int main() {
+    struct {
+        const char *name;
+        void (*run)();
+    } tests[] = {
+        { "cache_symmetries", testCacheSymmetries },
+        { "thread_count_determinism", testThreadCountDeterminism },
+        { "batch_worker_counts", testBatchWorkerCounts },
+        { "workspace_release", testWorkspaceRelease },
+        { "incremental_prior", testIncrementalPrior },
+        { "playout_legality", testPlayoutLegality },
+        { "playout_matches_goban", testPlayoutMatchesGoban },
+        { "session_play_undo", testSessionPlayUndo },
+        { "session_ko", testSessionKo },
+    };
+
+    for (size_t i=0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        int before = failures;
+        tests[i].run();
+        printf("%-28s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+    }
+    return failures;
+}
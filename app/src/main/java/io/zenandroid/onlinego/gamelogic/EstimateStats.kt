@@ -0,0 +1,46 @@
+package io.zenandroid.onlinego.gamelogic
+
+/**
+ * Where the time of one native territory estimate went, phase by phase.
+ * Mirrors EstimateStats in the native estimator.
+ */
+data class EstimateStats(val phases: List<Phase>) {
+
+  data class Phase(
+    val name: String,
+    val nanoseconds: Long,
+    val playouts: Long,
+    val moves: Long,
+    val captures: Long,
+    val illegalMoves: Long,
+    val floodFills: Long,
+  )
+
+  val totalNanoseconds: Long
+    get() = phases.sumOf { it.nanoseconds }
+
+  val totalPlayouts: Long
+    get() = phases.sumOf { it.playouts }
+
+  override fun toString() =
+    phases.joinToString(" ") { "${it.name}=${it.nanoseconds / 1000}us" } +
+        " total=${totalNanoseconds / 1000}us playouts=$totalPlayouts"
+
+  companion object {
+    // Same order as the native EstimateStats::Phase enum
+    val PHASE_NAMES = listOf(
+      "false_eyes", "components", "seki_rollout", "seki_scan",
+      "horseshoe", "static_maps", "pass1", "dead", "hole_fill",
+    )
+    private const val COUNTERS_PER_PHASE = 6
+    val ARRAY_SIZE = PHASE_NAMES.size * COUNTERS_PER_PHASE
+
+    /** Unpacks the counters estimateDirect writes out, phase by phase */
+    fun fromArray(values: LongArray) = EstimateStats(
+      PHASE_NAMES.mapIndexed { i, name ->
+        val o = i * COUNTERS_PER_PHASE
+        Phase(name, values[o], values[o + 1], values[o + 2], values[o + 3], values[o + 4], values[o + 5])
+      }
+    )
+  }
+}
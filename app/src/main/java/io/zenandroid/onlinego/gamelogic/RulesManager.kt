@@ -13,6 +13,8 @@ import io.zenandroid.onlinego.data.model.local.Score
 import io.zenandroid.onlinego.gamelogic.Util.toCoordinateSet
 import io.zenandroid.onlinego.ui.screens.game.Variation
 import kotlinx.coroutines.yield
+import java.io.Closeable
+import java.nio.ByteBuffer
 import java.util.LinkedList
 
 /**
@@ -34,39 +36,252 @@ object RulesManager {
 
   private val positionsCache = lruCache<CacheKey, Position>(1000)
 
-  private external fun estimate(w: Int, h: Int, board: IntArray, playerToMove: Int, trials: Int, tolerance: Float): IntArray
+  private external fun estimateDirect(w: Int, h: Int, board: ByteBuffer, out: ByteBuffer, columnMajor: Boolean, playerToMove: Int, trials: Int, tolerance: Float, seed: Int, budgetMs: Int, stats: LongArray?): Int
+  private external fun estimateBatch(w: Int, h: Int, count: Int, boards: ByteBuffer, playersToMove: ByteBuffer, out: ByteBuffer, columnMajor: Boolean, trials: Int, tolerance: Float, seed: Int): Int
+
+  private const val MAX_BOARD_CELLS = 25 * 25
+
+  // No wall clock budget: estimates play a fixed number of trials, so the native
+  // cache can hand them out again and the same position always scores the same
+  private const val ESTIMATE_BUDGET_MS = 0
+
+  // Rollout seed for every estimate, so the same position always scores the same
+  private const val ESTIMATE_SEED = 0x5eed
+
+  // Input and output buffers handed to estimateDirect, reused across calls on the same thread
+  private val estimateBuffers = object : ThreadLocal<Pair<ByteBuffer, ByteBuffer>>() {
+    override fun initialValue() =
+      ByteBuffer.allocateDirect(MAX_BOARD_CELLS) to ByteBuffer.allocateDirect(MAX_BOARD_CELLS)
+  }
+
+  /** Per phase timings and counters of the most recent determineTerritory call */
+  @Volatile
+  var lastEstimateStats: EstimateStats? = null
+    private set
+
+  private external fun sessionCreate(w: Int, h: Int): Long
+  private external fun sessionLoad(handle: Long, board: ByteBuffer, columnMajor: Boolean)
+  private external fun sessionPlay(handle: Long, x: Int, y: Int, player: Int): Int
+  private external fun sessionPass(handle: Long, player: Int)
+  private external fun sessionUndo(handle: Long): Boolean
+  private external fun sessionEstimate(handle: Long, out: ByteBuffer, columnMajor: Boolean, playerToMove: Int, trials: Int, tolerance: Float, seed: Int, budgetMs: Int, stats: LongArray?): Int
+  private external fun sessionRelease(handle: Long)
+
+  /**
+   * A game mirrored on the native side, for estimating one position after
+   * another as a game is played or stepped through. determineTerritory()
+   * works out how the position differs from the one it saw last and, when
+   * it is a single move, a pass or one step back, only sends that over; the
+   * native side resolves captures and ko itself. Anything else (a jump, a
+   * different board size, stones marked as removed) reloads the whole board.
+   * Estimating a position the session has just estimated costs nothing, and
+   * any other estimate is warm started from the previous one, so stepping
+   * through a game only redoes the part of the board each move touches.
+   * close() must be called when the session is no longer needed.
+   */
+  class GameSession : Closeable {
+    private val buffer = ByteBuffer.allocateDirect(MAX_BOARD_CELLS)
+    private var handle = 0L
+    private var width = 0
+    private var height = 0
+    private var closed = false
+
+    // Positions the native side went through since the last reload, the current one last
+    private val path = ArrayList<Position>()
+
+    @Synchronized
+    fun determineTerritory(pos: Position, scoreStones: Boolean): Position {
+      if (Thread.currentThread().name == "main") {
+        FirebaseCrashlytics.getInstance()
+          .recordException(Throwable("determineTerritory called on main thread!!!"))
+      }
+      check(!closed) { "GameSession used after close()" }
+      sync(pos)
+      val stats = LongArray(EstimateStats.ARRAY_SIZE)
+      sessionEstimate(
+        handle,
+        buffer,
+        true, // cells are indexed x * height + y
+        if (pos.nextToMove == StoneType.BLACK) 1 else -1,
+        1000,
+        .3f,
+        ESTIMATE_SEED,
+        ESTIMATE_BUDGET_MS,
+        stats
+      )
+      lastEstimateStats = EstimateStats.fromArray(stats)
+      return applyEstimate(pos, scoreStones) { x, y -> buffer.get(x * pos.boardHeight + y).toInt() }
+    }
+
+    @Synchronized
+    override fun close() {
+      closed = true
+      if (handle != 0L) {
+        sessionRelease(handle)
+        handle = 0L
+      }
+      path.clear()
+    }
+
+    private fun sync(pos: Position) {
+      val current = path.lastOrNull()
+      if (current == null || pos.boardWidth != width || pos.boardHeight != height ||
+        pos.removedSpots.isNotEmpty() || current.removedSpots.isNotEmpty()
+      ) {
+        load(pos)
+        return
+      }
+      val previous = path.getOrNull(path.size - 2)
+      when {
+        current === pos -> Unit
+        previous != null && previous.lastMove == pos.lastMove && previous.hasTheSameStonesAs(pos) -> {
+          sessionUndo(handle)
+          path.removeAt(path.lastIndex)
+        }
+        pos.lastMove.isPass() && pos.lastPlayerToMove != null && current.hasTheSameStonesAs(pos) -> {
+          sessionPass(handle, if (pos.lastPlayerToMove == StoneType.BLACK) 1 else -1)
+          path += pos
+        }
+        current.hasTheSameStonesAs(pos) -> path[path.lastIndex] = pos
+        !play(current, pos) -> load(pos)
+      }
+    }
+
+    // Sends pos.lastMove if that is all that separates pos from current
+    private fun play(current: Position, pos: Position): Boolean {
+      val move = pos.lastMove ?: return false
+      val player = pos.getStoneAt(move) ?: return false
+      if (move.isPass() || current.getStoneAt(move) != null) {
+        return false
+      }
+      val captured = sessionPlay(handle, move.x, move.y, if (player == StoneType.BLACK) 1 else -1)
+      val expected = if (player == StoneType.BLACK) {
+        pos.blackStones.size == current.blackStones.size + 1 &&
+            pos.whiteStones.size == current.whiteStones.size - captured
+      } else {
+        pos.whiteStones.size == current.whiteStones.size + 1 &&
+            pos.blackStones.size == current.blackStones.size - captured
+      }
+      // A mismatch gets reloaded, which also overwrites whatever was played
+      if (captured < 0 || !expected) {
+        return false
+      }
+      path += pos
+      return true
+    }
+
+    private fun load(pos: Position) {
+      if (handle == 0L || pos.boardWidth != width || pos.boardHeight != height) {
+        if (handle != 0L) {
+          sessionRelease(handle)
+          handle = 0L
+        }
+        width = pos.boardWidth
+        height = pos.boardHeight
+        handle = sessionCreate(width, height)
+        if (handle == 0L) {
+          throw IllegalArgumentException("Can't create a session for a ${width}x$height board")
+        }
+      }
+      packBoard(pos, buffer)
+      sessionLoad(handle, buffer, true)
+      path.clear()
+      path += pos
+    }
+  }
 
   fun determineTerritory(pos: Position, scoreStones: Boolean): Position {
     if (Thread.currentThread().name == "main") {
       FirebaseCrashlytics.getInstance()
         .recordException(Throwable("determineTerritory called on main thread!!!"))
     }
-    val inBoard = IntArray(pos.boardWidth * pos.boardHeight)
+    val (inBuffer, outBuffer) = estimateBuffers.get()!!
+    val stats = LongArray(EstimateStats.ARRAY_SIZE)
+    packBoard(pos, inBuffer)
+    estimateDirect(
+      pos.boardWidth,
+      pos.boardHeight,
+      inBuffer,
+      outBuffer,
+      true, // cells are indexed x * height + y
+      if (pos.nextToMove == StoneType.BLACK) 1 else -1,
+      1000,
+      .3f,
+      ESTIMATE_SEED,
+      ESTIMATE_BUDGET_MS,
+      stats
+    )
+    lastEstimateStats = EstimateStats.fromArray(stats)
+    return applyEstimate(pos, scoreStones) { x, y -> outBuffer.get(x * pos.boardHeight + y).toInt() }
+  }
+
+  /**
+   * Estimates a list of positions of the same size, such as every move of a game,
+   * in one native call that spreads them across the available cores.
+   */
+  fun determineTerritory(positions: List<Position>, scoreStones: Boolean): List<Position> {
+    if (positions.isEmpty()) {
+      return emptyList()
+    }
+    val width = positions[0].boardWidth
+    val height = positions[0].boardHeight
+    require(positions.all { it.boardWidth == width && it.boardHeight == height }) {
+      "All positions in a batch must have the same board size"
+    }
+    if (Thread.currentThread().name == "main") {
+      FirebaseCrashlytics.getInstance()
+        .recordException(Throwable("determineTerritory called on main thread!!!"))
+    }
+
+    val cells = width * height
+    val inBuffer = ByteBuffer.allocateDirect(positions.size * cells)
+    val players = ByteBuffer.allocateDirect(positions.size)
+    val outBuffer = ByteBuffer.allocateDirect(positions.size * cells)
+    positions.forEachIndexed { i, pos ->
+      packBoard(pos, inBuffer, i * cells)
+      players.put(i, if (pos.nextToMove == StoneType.BLACK) 1 else -1)
+    }
+    estimateBatch(
+      width,
+      height,
+      positions.size,
+      inBuffer,
+      players,
+      outBuffer,
+      true, // cells are indexed x * height + y
+      1000,
+      .3f,
+      ESTIMATE_SEED
+    )
+    return positions.mapIndexed { i, pos ->
+      applyEstimate(pos, scoreStones) { x, y -> outBuffer.get(i * cells + x * height + y).toInt() }
+    }
+  }
+
+  private fun packBoard(pos: Position, out: ByteBuffer, offset: Int = 0) {
+    for (i in 0 until pos.boardWidth * pos.boardHeight) {
+      out.put(offset + i, 0)
+    }
     pos.blackStones
       .filter { !pos.removedSpots.contains(it) }
       .forEach {
-        inBoard[it.x * pos.boardHeight + it.y] = 1
+        out.put(offset + it.x * pos.boardHeight + it.y, 1)
       }
     pos.whiteStones
       .filter { !pos.removedSpots.contains(it) }
       .forEach {
-        inBoard[it.x * pos.boardHeight + it.y] = -1
+        out.put(offset + it.x * pos.boardHeight + it.y, -1)
       }
-    val outBoard = estimate(
-      pos.boardHeight, // Note: There is a bug in the estimator somewhere, width and height should be in the different order!!!
-      pos.boardWidth, // Note: There is a bug in the estimator somewhere, width and height should be in the different order!!!
-      inBoard,
-      if (pos.nextToMove == StoneType.BLACK) 1 else -1,
-      1000,
-      .3f
-    )
+  }
+
+  private inline fun applyEstimate(pos: Position, scoreStones: Boolean, ownership: (Int, Int) -> Int): Position {
     val whiteTerritory = mutableSetOf<Cell>()
     val blackTerritory = mutableSetOf<Cell>()
     val removedCells = mutableSetOf<Cell>()
 
     for (x in 0 until pos.boardWidth) {
       for (y in 0 until pos.boardHeight) {
-        when (outBoard[x * pos.boardHeight + y]) {
+        when (ownership(x, y)) {
           -1 -> {
             val cell = Cell(x, y)
             whiteTerritory += cell
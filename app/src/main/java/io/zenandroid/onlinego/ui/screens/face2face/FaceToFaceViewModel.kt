@@ -78,6 +78,9 @@ class FaceToFaceViewModel(
   private var currentGameParameters by mutableStateOf(GameParameters(BoardSize.LARGE, 0))
   private var newGameParameters by mutableStateOf(GameParameters(BoardSize.LARGE, 0))
 
+  // Estimates of consecutive positions only send the moves in between
+  private val estimateSession = RulesManager.GameSession()
+
   init {
     analytics.logEvent("face_to_face_opened", null)
     viewModelScope.launch(Dispatchers.IO) {
@@ -183,6 +186,7 @@ class FaceToFaceViewModel(
       settingsRepository.setFaceToFaceHistory(history.joinToString(separator = " ") { "${it.x},${it.y}" })
       settingsRepository.setFaceToFaceBoardSize(currentGameParameters.size.toString())
       settingsRepository.setFaceToFaceHandicap(currentGameParameters.handicap)
+      estimateSession.close()
     }
     super.onCleared()
   }
@@ -213,7 +217,7 @@ class FaceToFaceViewModel(
   private fun doEstimation() {
     estimateStatus = Working
     viewModelScope.launch(Dispatchers.IO) {
-      val estimate = RulesManager.determineTerritory(currentPosition, false)
+      val estimate = estimateSession.determineTerritory(currentPosition, false)
       withContext(Dispatchers.Main) {
         val index = historyIndex ?: history.lastIndex
         val finished =
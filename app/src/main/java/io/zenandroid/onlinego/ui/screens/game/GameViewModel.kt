@@ -201,6 +201,12 @@ class GameViewModel(
 
   private var timerJob: Job? = null
 
+  // Estimates made while stepping through the game only send the moves in between
+  private val estimateSession = RulesManager.GameSession()
+
+  // Estimates of every main line position, scored in one batch when reviewing the game
+  private var reviewEstimates by mutableStateOf<List<Position>?>(null)
+
   lateinit var state: StateFlow<GameState>
   private val _events = MutableSharedFlow<Event?>(
     extraBufferCapacity = 1,
@@ -262,14 +268,30 @@ class GameViewModel(
           game?.let { calculateAnalysisPosition(it) }
         }
       }
+      if (estimateMode && analyzeMode && game != null) {
+        LaunchedEffect(game?.id, game?.moves?.size) {
+          reviewEstimates = null
+          withContext(Dispatchers.Default) {
+            game?.let {
+              val timeline = (0..(it.moves?.size ?: 0)).map { moveNo -> RulesManager.replay(it, moveNo) }
+              reviewEstimates = RulesManager.determineTerritory(timeline, it.scoreStones == true)
+            }
+          }
+        }
+      }
       if (estimateMode && game != null) {
         LaunchedEffect(analysisPosition, currentGamePosition) {
           withContext(Dispatchers.Default) {
             game?.let {
               val basePosition =
                 if (analyzeMode && analysisPosition != null) analysisPosition!! else currentGamePosition.value
+              val onMainLine = currentVariation.let { v -> v == null || analysisShownMoveNumber <= v.rootMoveNo }
+              val reviewed =
+                if (analyzeMode && analysisPosition != null && onMainLine) reviewEstimates?.getOrNull(analysisShownMoveNumber)
+                else null
               estimatePosition =
-                RulesManager.determineTerritory(basePosition, it.scoreStones == true)
+                reviewed?.copy(customMarks = basePosition.customMarks, variation = basePosition.variation)
+                  ?: estimateSession.determineTerritory(basePosition, it.scoreStones == true)
             }
           }
         }
@@ -799,6 +821,7 @@ class GameViewModel(
   override fun onCleared() {
     appCoroutineScope.launch(Dispatchers.IO) {
       gameConnection.close()
+      estimateSession.close()
     }
     super.onCleared()
   }